@@ -13,6 +13,7 @@
 #include <validation.h>
 #include <util.h>
 
+#include <algorithm>
 #include <unordered_map>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
@@ -27,6 +28,30 @@ CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool f
     }
 }
 
+PayloadDeferredTransaction::PayloadDeferredTransaction(const CTransactionRef& txIn) {
+    if (txIn->data.size() < DATA_PAYLOAD_DEFER_SIZE) {
+        tx = txIn;
+        return;
+    }
+    CMutableTransaction mtx(*txIn);
+    mtx.data.clear();
+    tx = MakeTransactionRef(std::move(mtx));
+    payloadHash = Hash(txIn->data.begin(), txIn->data.end());
+}
+
+CTransactionRef PayloadDeferredTransaction::WithPayload(const std::vector<unsigned char>& payload) const {
+    CMutableTransaction mtx(*tx);
+    mtx.data = payload;
+    return MakeTransactionRef(std::move(mtx));
+}
+
+BlockTransactionsDeferred::BlockTransactionsDeferred(const BlockTransactions& resp) :
+        blockhash(resp.blockhash) {
+    txn.reserve(resp.txn.size());
+    for (const CTransactionRef& tx : resp.txn)
+        txn.emplace_back(tx);
+}
+
 void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     stream << header << nonce;
@@ -167,6 +192,11 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     return READ_STATUS_OK;
 }
 
+size_t PartiallyDownloadedBlock::MissingTxCount() const {
+    assert(!header.IsNull());
+    return std::count(txn_available.begin(), txn_available.end(), nullptr);
+}
+
 bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const {
     assert(!header.IsNull());
     assert(index < txn_available.size());
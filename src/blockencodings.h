@@ -11,6 +11,9 @@
 
 class CTxMemPool;
 
+/** Data fields at least this large are left out of "blocktxnd" responses and fetched by hash */
+static const unsigned int DATA_PAYLOAD_DEFER_SIZE = 16 * 1024;
+
 // Dumb helper to handle CTransaction compression at serialize-time
 struct TransactionCompressor {
 private:
@@ -99,6 +102,60 @@ public:
     }
 };
 
+// A block transaction whose large data payload may have been left out, to be fetched
+// separately by its hash (possibly from several peers)
+struct PayloadDeferredTransaction {
+    // The transaction, with an empty data field if the payload was deferred
+    CTransactionRef tx;
+    // Hash of the left-out data field, null if the transaction is complete
+    uint256 payloadHash;
+
+    PayloadDeferredTransaction() {}
+    explicit PayloadDeferredTransaction(const CTransactionRef& txIn);
+
+    bool IsDeferred() const { return !payloadHash.IsNull(); }
+    // Rebuild the full transaction; the caller checks that payload matches payloadHash
+    CTransactionRef WithPayload(const std::vector<unsigned char>& payload) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(REF(TransactionCompressor(tx)));
+        READWRITE(payloadHash);
+    }
+};
+
+class BlockTransactionsDeferred {
+public:
+    // A BlockTransactionsDeferred message
+    uint256 blockhash;
+    std::vector<PayloadDeferredTransaction> txn;
+
+    BlockTransactionsDeferred() {}
+    explicit BlockTransactionsDeferred(const BlockTransactions& resp);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(blockhash);
+        uint64_t txn_size = (uint64_t)txn.size();
+        READWRITE(COMPACTSIZE(txn_size));
+        if (ser_action.ForRead()) {
+            size_t i = 0;
+            while (txn.size() < txn_size) {
+                txn.resize(std::min((uint64_t)(1000 + txn.size()), txn_size));
+                for (; i < txn.size(); i++)
+                    READWRITE(txn[i]);
+            }
+        } else {
+            for (size_t i = 0; i < txn.size(); i++)
+                READWRITE(txn[i]);
+        }
+    }
+};
+
 // Dumb serialization/storage-helper for CBlockHeaderAndShortTxIDs and PartiallyDownloadedBlock
 struct PrefilledTransaction {
     // Used as an offset since last prefilled tx in CBlockHeaderAndShortTxIDs,
@@ -203,6 +260,8 @@ public:
     // extra_txn is a list of extra transactions to look at, in <witness hash, reference> form
     ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn);
     bool IsTxAvailable(size_t index) const;
+    //! Number of transactions still to be provided to FillBlock
+    size_t MissingTxCount() const;
     ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
 };
 
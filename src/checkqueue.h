@@ -8,6 +8,10 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -25,12 +29,37 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Work is spread over per-worker deques, each with its own lock. A worker
+  * takes batches from the back of its own deque and, when that is empty,
+  * steals from the front of another worker's. Completion is tracked with
+  * atomic counters, so the shared mutex is only taken to sleep and wake up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Upper bound on the number of deques; further workers share them
+    static const unsigned int MAX_WORKER_SLOTS = 64;
+
+    struct WorkerSlot {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Per-worker deques. Slot 0 belongs to the master.
+    std::unique_ptr<WorkerSlot[]> slots;
+
+    //! Number of slots in use (the master's plus one per registered worker)
+    std::atomic<unsigned int> nSlots;
+
+    //! Number of worker threads that have started
+    std::atomic<unsigned int> nWorkers;
+
+    //! Slot the master adds the next batch to
+    unsigned int nNextSlot;
+
+    //! Mutex to protect sleeping and waking up
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,87 +68,117 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of workers (excluding the master) that are idle.
+    std::atomic<int> nIdle;
 
-    //! The total number of workers (including the master).
-    int nTotal;
-
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! Number of verifications sitting in a deque, not yet taken by a worker
+    std::atomic<int64_t> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<int64_t> nTodo;
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /** Move checks out of a slot into vChecks: up to nBatchSize from the back
+     *  of our own deque, or from the front of someone else's when stealing.
+     *  A steal takes at most half of what is there, leaving the rest for the
+     *  owner and other thieves. */
+    bool Take(unsigned int nSlot, bool fSteal, std::vector<T>& vChecks)
+    {
+        WorkerSlot& slot = slots[nSlot];
+        boost::unique_lock<boost::mutex> lock(slot.mutex);
+        size_t nAvail = slot.checks.size();
+        if (nAvail == 0)
+            return false;
+        size_t nNow = fSteal ? std::max<size_t>(1, std::min<size_t>(nBatchSize, nAvail / 2))
+                             : std::min<size_t>(nBatchSize, nAvail);
+        vChecks.resize(nNow);
+        for (size_t i = 0; i < nNow; i++) {
+            // Swap jobs out of the deque instead of copying
+            if (fSteal) {
+                vChecks[i].swap(slot.checks.front());
+                slot.checks.pop_front();
+            } else {
+                vChecks[i].swap(slot.checks.back());
+                slot.checks.pop_back();
+            }
+        }
+        nQueued -= nNow;
+        return true;
+    }
+
+    /** Find a batch of work, looking at our own slot first. */
+    bool FindWork(unsigned int nOwnSlot, std::vector<T>& vChecks)
+    {
+        if (Take(nOwnSlot, false, vChecks))
+            return true;
+        const unsigned int nCount = nSlots;
+        for (unsigned int i = 1; i < nCount && nQueued > 0; i++) {
+            if (Take((nOwnSlot + i) % nCount, true, vChecks))
+                return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        unsigned int nOwnSlot = 0;
+        if (!fMaster) {
+            unsigned int nWorker = nWorkers++;
+            nOwnSlot = 1 + nWorker % (MAX_WORKER_SLOTS - 1);
+            if (nWorker < MAX_WORKER_SLOTS - 1)
+                nSlots++;
+        }
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if (!FindWork(nOwnSlot, vChecks)) {
+                if (nQueued > 0) {
+                    // The master is still filling a deque; let it run
+                    std::this_thread::yield();
+                    continue;
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (fMaster) {
+                    while (nTodo != 0)
+                        condMaster.wait(lock);
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                nIdle++;
+                while (nQueued == 0)
+                    condWorker.wait(lock); // wait
+                nIdle--;
+                continue;
             }
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
             for (T& check : vChecks)
                 if (fOk)
                     fOk = check();
+            const int64_t nNow = vChecks.size();
+            // Destroy the checks before reporting them done
             vChecks.clear();
+            if (!fOk)
+                fAllOk = false;
+            if ((nTodo -= nNow) == 0 && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
@@ -128,7 +187,9 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) :
+        slots(new WorkerSlot[MAX_WORKER_SLOTS]), nSlots(1), nWorkers(0), nNextSlot(0),
+        nIdle(0), nQueued(0), nTodo(0), fAllOk(true), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -145,16 +206,32 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+        // Count the work before it becomes visible, so that nTodo cannot
+        // drop to zero while this batch is still being distributed.
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        nQueued += vChecks.size();
+        // Spread the checks round-robin over the deques in chunks of nBatchSize
+        const unsigned int nCount = nSlots;
+        for (size_t nStart = 0; nStart < vChecks.size(); nStart += nBatchSize) {
+            WorkerSlot& slot = slots[nNextSlot++ % nCount];
+            boost::unique_lock<boost::mutex> lock(slot.mutex);
+            const size_t nEnd = std::min(vChecks.size(), nStart + nBatchSize);
+            for (size_t i = nStart; i < nEnd; i++) {
+                slot.checks.push_back(T());
+                vChecks[i].swap(slot.checks.back());
+            }
+        }
+        // Workers mark themselves idle before re-checking nQueued under the
+        // mutex, so either they see this batch or we see them idle.
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
@@ -86,8 +86,15 @@ typedef int32_t ssize_t;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// poll() has no FD_SETSIZE limit; epoll additionally keeps socket registrations across
+// calls. WSAPoll on Windows and poll on macOS are unreliable, so they keep using select().
+#if defined(__linux__)
+#define USE_POLL
+#define USE_EPOLL
+#endif
+
 bool static inline IsSelectableSocket(const SOCKET& s) {
-#ifdef WIN32
+#if defined(USE_POLL) || defined(WIN32)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -475,6 +475,21 @@ public:
             }
         return false;
     }
+
+    /* get_live appends every element which has not been marked for erasure
+     * to out, e.g. to persist the cache across restarts.
+     *
+     * Requires the same external synchronization as insert.
+     *
+     * @param out the vector to append to
+     * @post out contains every live element of the table
+     */
+    void get_live(std::vector<Element>& out) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                out.push_back(table[i]);
+    }
 };
 } // namespace CuckooCache
 
@@ -7,6 +7,7 @@
 #include <base58.h>
 #include <chainparams.h>
 #include <httpserver.h>
+#include <rpc/jsonstream.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <random.h>
@@ -144,14 +145,9 @@ static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUserna
     return multiUserAuthorized(strUserPass);
 }
 
-static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
+/** Check the credentials of a request, replying with an error if they are missing or wrong */
+static bool HTTPReq_Authorized(HTTPRequest* req, JSONRPCRequest& jreq)
 {
-    // JSONRPC handles only POST
-    if (req->GetRequestMethod() != HTTPRequest::POST) {
-        req->WriteReply(HTTP_BAD_METHOD, "JSONRPC server handles only POST requests");
-        return false;
-    }
-    // Check authorization
     std::pair<bool, std::string> authHeader = req->GetHeader("authorization");
     if (!authHeader.first) {
         req->WriteHeader("WWW-Authenticate", WWW_AUTH_HEADER_DATA);
@@ -159,7 +155,6 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         return false;
     }
 
-    JSONRPCRequest jreq;
     if (!RPCAuthorized(authHeader.second, jreq.authUser)) {
         LogPrintf("ThreadRPCServer incorrect password attempt from %s\n", req->GetPeer().ToString());
 
@@ -172,6 +167,20 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         req->WriteReply(HTTP_UNAUTHORIZED);
         return false;
     }
+    return true;
+}
+
+static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
+{
+    // JSONRPC handles only POST
+    if (req->GetRequestMethod() != HTTPRequest::POST) {
+        req->WriteReply(HTTP_BAD_METHOD, "JSONRPC server handles only POST requests");
+        return false;
+    }
+    // Check authorization
+    JSONRPCRequest jreq;
+    if (!HTTPReq_Authorized(req, jreq))
+        return false;
 
     try {
         // Parse request
@@ -187,7 +196,39 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq);
+            // Let the handler stream large results; the reply is started as
+            // soon as the first chunk is ready
+            bool fChunked = false;
+            JSONStreamWriter stream([req, &fChunked](const std::string& chunk) {
+                if (!fChunked) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    req->StartChunkedReply(HTTP_OK);
+                    req->WriteReplyChunk("{\"result\":");
+                    fChunked = true;
+                }
+                req->WriteReplyChunk(chunk);
+            });
+            jreq.stream = &stream;
+
+            UniValue result;
+            try {
+                result = tableRPC.execute(jreq);
+            } catch (...) {
+                if (fChunked) {
+                    // Too late to send an error reply, cut off the body instead
+                    LogPrintf("ThreadRPCServer %s failed after starting the reply\n", SanitizeString(jreq.strMethod));
+                    req->EndChunkedReply();
+                    return false;
+                }
+                throw;
+            }
+
+            if (!stream.empty()) {
+                stream.flush();
+                req->WriteReplyChunk(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+                req->EndChunkedReply();
+                return true;
+            }
 
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
@@ -210,6 +251,59 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     return true;
 }
 
+#ifdef ENABLE_WALLET
+/**
+ * Binary data upload: the request body is the raw payload of a data
+ * transaction, so large payloads skip the JSON and base64 round trip.
+ * Handled by the senddata RPC, with optional parameters taken from headers.
+ */
+static bool HTTPReq_SendData(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (req->GetRequestMethod() != HTTPRequest::POST) {
+        req->WriteReply(HTTP_BAD_METHOD, "senddata handles only POST requests");
+        return false;
+    }
+    JSONRPCRequest jreq;
+    if (!HTTPReq_Authorized(req, jreq))
+        return false;
+
+    try {
+        // /senddata/<walletname> selects a wallet like /wallet/<walletname> does
+        if (strURIPart.size() > 1 && strURIPart[0] == '/')
+            jreq.URI = "/wallet/" + strURIPart.substr(1);
+        else if (!strURIPart.empty())
+            throw JSONRPCError(RPC_INVALID_REQUEST, "Invalid URI");
+        else
+            jreq.URI = req->GetURI();
+
+        jreq.strMethod = "senddata";
+        req->ReadBody(jreq.binaryData);
+        if (jreq.binaryData.empty())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Empty request body");
+
+        jreq.params = UniValue(UniValue::VARR);
+        jreq.params.push_back(NullUniValue);
+        std::pair<bool, std::string> feeRate = req->GetHeader("X-Fee-Rate");
+        std::pair<bool, std::string> changeAddress = req->GetHeader("X-Change-Address");
+        jreq.params.push_back(feeRate.first ? UniValue(feeRate.second) : NullUniValue);
+        if (changeAddress.first)
+            jreq.params.push_back(changeAddress.second);
+
+        UniValue result = tableRPC.execute(jreq);
+
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, JSONRPCReply(result, NullUniValue, jreq.id));
+    } catch (const UniValue& objError) {
+        JSONErrorReply(req, objError, jreq.id);
+        return false;
+    } catch (const std::exception& e) {
+        JSONErrorReply(req, JSONRPCError(RPC_MISC_ERROR, e.what()), jreq.id);
+        return false;
+    }
+    return true;
+}
+#endif
+
 static bool InitRPCAuthentication()
 {
     if (gArgs.GetArg("-rpcpassword", "") == "")
@@ -238,6 +332,7 @@ bool StartHTTPRPC()
 #ifdef ENABLE_WALLET
     // ifdef can be removed once we switch to better endpoint support and API versioning
     RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/senddata", false, HTTPReq_SendData);
 #endif
     assert(EventBase());
     httpRPCTimerInterface = MakeUnique<HTTPRPCTimerInterface>(EventBase());
@@ -254,6 +349,9 @@ void StopHTTPRPC()
 {
     LogPrint(BCLog::RPC, "Stopping HTTP RPC server\n");
     UnregisterHTTPHandler("/", true);
+#ifdef ENABLE_WALLET
+    UnregisterHTTPHandler("/senddata", false);
+#endif
     if (httpRPCTimerInterface) {
         RPCUnsetTimerInterface(httpRPCTimerInterface.get());
         httpRPCTimerInterface.reset();
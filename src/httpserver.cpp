@@ -13,7 +13,11 @@
 #include <sync.h>
 #include <ui_interface.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -523,13 +527,41 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+/** Backpressure for a chunked reply */
+struct HTTPChunkedReplyState
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    //! Bytes passed to WriteReplyChunk that have not been written to the socket
+    size_t nPending = 0;
+    //! Part of nPending that has been handed to libevent already
+    size_t nSubmitted = 0;
+};
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+/** Called by libevent when the connection's output buffer has drained */
+static void http_reply_chunk_written_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPChunkedReplyState* state = static_cast<HTTPChunkedReplyState*>(arg);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->nPending -= state->nSubmitted;
+    state->nSubmitted = 0;
+    state->cond.notify_all();
+}
+#endif
+
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       chunkedReply(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (chunkedReply && !replySent) {
+        // The status line has gone out already, just terminate the body
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -568,6 +600,17 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+void HTTPRequest::ReadBody(std::vector<unsigned char>& vchBody)
+{
+    vchBody.clear();
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return;
+    vchBody.resize(evbuffer_get_length(buf));
+    if (!vchBody.empty())
+        evbuffer_remove(buf, vchBody.data(), vchBody.size());
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -607,6 +650,78 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = nullptr; // transferred back to main thread
 }
 
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && !chunkedReply && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+    chunkedReply = true;
+    chunkState = std::make_shared<HTTPChunkedReplyState>();
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && chunkedReply && req);
+    if (strChunk.empty())
+        return;
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+    {
+        // Wait for the client to catch up before queueing more
+        std::unique_lock<std::mutex> lock(chunkState->mutex);
+        const std::chrono::seconds timeout(gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+        if (!chunkState->cond.wait_for(lock, timeout, [this]{ return chunkState->nPending < HTTP_CHUNKED_REPLY_HIGH_WATER; }))
+            throw std::runtime_error("Timed out waiting for the client to read the reply");
+        chunkState->nPending += strChunk.size();
+    }
+#endif
+    // Events are run in the order they were triggered, so chunks are sent in order
+    auto req_copy = req;
+    auto state = chunkState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, strChunk, state]{
+        struct evbuffer* evb = evbuffer_new();
+        assert(evb);
+        evbuffer_add(evb, strChunk.data(), strChunk.size());
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->nSubmitted += strChunk.size();
+        }
+        evhttp_send_reply_chunk_with_cb(req_copy, evb, http_reply_chunk_written_cb, state.get());
+#else
+        evhttp_send_reply_chunk(req_copy, evb);
+#endif
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(!replySent && chunkedReply && req);
+    auto req_copy = req;
+    // Keep the state alive until the end of the reply has replaced our write callback
+    auto state = chunkState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, state]{
+        evhttp_send_reply_end(req_copy);
+        // Re-enable reading from the socket, as in WriteReply
+        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+            if (conn) {
+                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+                if (bev) {
+                    bufferevent_enable(bev, EV_READ | EV_WRITE);
+                }
+            }
+        }
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
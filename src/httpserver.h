@@ -8,15 +8,20 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
+#include <vector>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** A chunked reply stops producing output while this many bytes wait to be sent */
+static const size_t HTTP_CHUNKED_REPLY_HIGH_WATER = 1024 * 1024;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPChunkedReplyState;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -59,6 +64,9 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool chunkedReply;
+    //! Shared with the event thread, to track how much of a chunked reply is unsent
+    std::shared_ptr<HTTPChunkedReplyState> chunkState;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req);
@@ -98,6 +106,12 @@ public:
      */
     std::string ReadBody();
 
+    /** Read request body into a byte vector, without an intermediate string.
+     *
+     * @note As this consumes the underlying buffer, call this only once.
+     */
+    void ReadBody(std::vector<unsigned char>& vchBody);
+
     /**
      * Write output header.
      *
@@ -114,6 +128,33 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply, for bodies that are produced incrementally.
+     * The body is then sent with WriteReplyChunk and finished with
+     * EndChunkedReply.
+     *
+     * @note Call this instead of WriteReply, after writing the headers.
+     */
+    void StartChunkedReply(int nStatus);
+
+    /**
+     * Send a part of the body of a chunked reply. Blocks while more than
+     * HTTP_CHUNKED_REPLY_HIGH_WATER bytes are still waiting to go out, so a
+     * slow client cannot make the reply pile up in memory.
+     *
+     * @throws std::runtime_error if the client does not read for longer
+     * than -rpcservertimeout.
+     */
+    void WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Finish a chunked reply.
+     *
+     * @note As this will give the request back to the main thread, do not
+     * call any other HTTPRequest methods after calling this.
+     */
+    void EndChunkedReply();
 };
 
 /** Event handler closure.
@@ -47,8 +47,32 @@
 // pool, we select by highest fee rate of a transaction combined with all
 // its ancestors.
 
-uint64_t nLastBlockTx = 0;
-uint64_t nLastBlockWeight = 0;
+std::atomic<uint64_t> nLastBlockTx{0};
+std::atomic<uint64_t> nLastBlockWeight{0};
+
+namespace {
+/**
+ * The transaction selection of the last template, so the next one can start from it
+ * instead of walking the mempool again. Protected by cs_main.
+ */
+struct TemplateSelection
+{
+    bool fValid = false;
+    // What the selection was made against
+    uint256 hashPrevBlock;
+    int nHeight = 0;
+    int64_t nLockTimeCutoff = 0;
+    unsigned int nTransactionsUpdated = 0;
+    unsigned int nFeeDeltasUpdated = 0;
+    bool fIncludeWitness = false;
+    unsigned int nBlockMaxWeight = 0;
+    CFeeRate blockMinFeeRate;
+    // Selected transactions in block order, without the coinbase
+    std::vector<uint256> vTxHashes;
+    bool fCapacityLimited = false;
+};
+TemplateSelection lastSelection;
+} // namespace
 
 double dPrimesPerSec = 0.0;
 double dChainsPerDay = 0.0;
@@ -112,6 +136,7 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+    fCapacityLimited = false;
 }
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
@@ -163,9 +188,40 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
 
+    // Reuse the last selection when possible. With nothing changed it is the result
+    // already, and it was validated against this tip. After a new block or mempool
+    // changes, a selection that had room for every package is still part of the
+    // optimal one, so only the rest is added. If it was full, better packages may
+    // have arrived, so start over. A changed fee delta can move or drop transactions
+    // already selected, so that starts over too.
+    const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    const unsigned int nFeeDeltasUpdated = mempool.GetFeeDeltasUpdated();
+    bool fUnchanged = false;
+    bool fReused = false;
+    if (lastSelection.fValid && lastSelection.nFeeDeltasUpdated == nFeeDeltasUpdated && lastSelection.fIncludeWitness == fIncludeWitness &&
+            lastSelection.nBlockMaxWeight == nBlockMaxWeight && lastSelection.blockMinFeeRate == blockMinFeeRate) {
+        const bool fSameTip = lastSelection.hashPrevBlock == pindexPrev->GetBlockHash();
+        const bool fExtendsTip = pindexPrev->pprev && lastSelection.hashPrevBlock == pindexPrev->pprev->GetBlockHash();
+        fUnchanged = fSameTip && lastSelection.nHeight == nHeight && lastSelection.nLockTimeCutoff == nLockTimeCutoff &&
+            lastSelection.nTransactionsUpdated == nTransactionsUpdated;
+        if (fUnchanged || ((fSameTip || fExtendsTip) && !lastSelection.fCapacityLimited)) {
+            fReused = addPreviousSelection(lastSelection.vTxHashes, fUnchanged);
+            if (!fReused) {
+                resetBlock();
+                pblock->vtx.resize(1);
+                pblocktemplate->vTxFees.resize(1);
+                pblocktemplate->vTxSigOpsCost.resize(1);
+            }
+        }
+    }
+    fUnchanged &= fReused;
+    if (fUnchanged)
+        fCapacityLimited = lastSelection.fCapacityLimited;
+
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    if (!fUnchanged)
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -203,13 +259,32 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblock->nNonce         = 0;
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 
-    CValidationState state;
-    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
-        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+    // The same transactions on the same tip were validated for the last template;
+    // only the coinbase and time differ
+    if (!fUnchanged) {
+        CValidationState state;
+        if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+            lastSelection.fValid = false;
+            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+        }
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    lastSelection.fValid = true;
+    lastSelection.hashPrevBlock = pindexPrev->GetBlockHash();
+    lastSelection.nHeight = nHeight;
+    lastSelection.nLockTimeCutoff = nLockTimeCutoff;
+    lastSelection.nTransactionsUpdated = nTransactionsUpdated;
+    lastSelection.nFeeDeltasUpdated = nFeeDeltasUpdated;
+    lastSelection.fIncludeWitness = fIncludeWitness;
+    lastSelection.nBlockMaxWeight = nBlockMaxWeight;
+    lastSelection.blockMinFeeRate = blockMinFeeRate;
+    lastSelection.vTxHashes.clear();
+    for (size_t i = 1; i < pblock->vtx.size(); i++)
+        lastSelection.vTxHashes.push_back(pblock->vtx[i]->GetHash());
+    lastSelection.fCapacityLimited = fCapacityLimited;
+
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants, %s), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, fUnchanged ? "unchanged" : fReused ? "extended" : "rebuilt", 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -252,6 +327,23 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
+bool BlockAssembler::addPreviousSelection(const std::vector<uint256>& vHashes, bool fRequireAll)
+{
+    for (const uint256& hash : vHashes) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            // Confirmed, or removed together with its descendants
+            if (fRequireAll)
+                return false;
+            continue;
+        }
+        if (!TestPackageTransactions(CTxMemPool::setEntries{it}))
+            return false;
+        AddToBlock(it);
+    }
+    return true;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
@@ -409,6 +501,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            fCapacityLimited = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -503,19 +596,23 @@ bool CheckWork(CBlock* pblock, CWallet& wallet, std::shared_ptr<CReserveScript>
         LOCK(cs_main);
         if (pblock->hashPrevBlock != pindexBestHeader->GetBlockHash())// pcoinsTip->GetBestBlock()) //TODO: chainActive.Tip()->GetBlockHash()?
             return error("DatacoinMiner : generated block is stale");
-
-        // Process this block the same as if we had received it from another node
-        //CValidationState state;
-		bool fNewBlock;
-        if (!ProcessNewBlock(Params(), std::make_shared<const CBlock>(*pblock) , true, &fNewBlock))
-            return error("DatacoinMiner : ProcessNewBlock, block not accepted");
-
-        // Remove key from key pool
-        //reservekey.KeepKey(); //DATACOIN MINER
-        reserve_script->KeepScript();
-
     }
 
+    // Process this block the same as if we had received it from another node, minus
+    // the proof-of-work check done above. Not holding cs_main here lets the compact
+    // block and header announcements go out from NewPoWValidBlock before connecting.
+    //CValidationState state;
+    std::shared_ptr<const CBlock> pblockShared = std::make_shared<const CBlock>(*pblock);
+    pblockShared->fCheckedPoW = true;
+    pblockShared->fLocallyMined = true;
+    bool fNewBlock;
+    if (!ProcessNewBlock(Params(), pblockShared, true, &fNewBlock))
+        return error("DatacoinMiner : ProcessNewBlock, block not accepted");
+
+    // Remove key from key pool
+    //reservekey.KeepKey(); //DATACOIN MINER
+    reserve_script->KeepScript();
+
     return true;
 }
 
@@ -163,6 +163,8 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // Whether a package above the fee floor was left out for lack of room
+    bool fCapacityLimited;
 
     // Chain context for the block
     int nHeight;
@@ -188,6 +190,10 @@ private:
     void resetBlock();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Add the transactions selected for a previous template that are still in the
+      * mempool, in the same order. Fails if one is no longer final, or if fRequireAll
+      * and one has left the mempool. */
+    bool addPreviousSelection(const std::vector<uint256>& vHashes, bool fRequireAll);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
@@ -83,6 +83,10 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default number of threads deserializing received blocks and transactions ahead of the message handler */
+static const int DEFAULT_MSG_DECODE_THREADS = 2;
+/** Maximum number of message decode threads */
+static const int MAX_MSG_DECODE_THREADS = 16;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
@@ -99,6 +103,21 @@ struct AddedNodeInfo
 
 class CNodeStats;
 class CClientUIInterface;
+class CBlock;
+class CTransaction;
+
+/**
+ * An immutable serialized message payload together with its hash (of which the
+ * message checksum is a prefix). One payload can be queued to many peers at once.
+ */
+struct CNetMsgPayload
+{
+    explicit CNetMsgPayload(std::vector<unsigned char>&& dataIn) : data(std::move(dataIn)), hash(Hash(data.begin(), data.end())) {}
+
+    const std::vector<unsigned char> data;
+    const uint256 hash;
+};
+typedef std::shared_ptr<const CNetMsgPayload> CNetMsgPayloadRef;
 
 struct CSerializedNetMsg
 {
@@ -111,9 +130,12 @@ struct CSerializedNetMsg
 
     std::vector<unsigned char> data;
     std::string command;
+    //! If set, the message is sent from this shared payload and data is ignored.
+    CNetMsgPayloadRef payload;
 };
 
 class NetEventsInterface;
+struct CNetMessageDecodeJob;
 class CConnman
 {
 public:
@@ -145,6 +167,7 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        int nMsgDecodeThreads = 0;
     };
 
     void Init(const Options& connOptions) {
@@ -158,6 +181,7 @@ public:
         m_msgproc = connOptions.m_msgproc;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        nMsgDecodeThreads = std::max(0, std::min(connOptions.nMsgDecodeThreads, MAX_MSG_DECODE_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -312,6 +336,8 @@ public:
     CSipHasher GetDeterministicRandomizer(uint64_t id) const;
 
     unsigned int GetReceiveFloodSize() const;
+    /** Number of received messages waiting for a decode thread */
+    size_t GetMsgDecodeQueueSize();
 
     void WakeMessageHandler();
 private:
@@ -330,7 +356,19 @@ private:
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
     void ThreadMessageHandler();
+    void ThreadMessageDecode();
     void AcceptConnection(const ListenSocket& hListenSocket);
+    void DisconnectNodes();
+    void NotifyNumConnectionsChanged();
+    void InactivityCheck(CNode *pnode);
+    bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+    void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+    void SocketHandler();
+#ifdef USE_EPOLL
+    void SocketHandlerEdgeTriggered();
+#endif
+    void RegisterSocketEvents(CNode *pnode);
+    bool SocketRecvData(CNode *pnode);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -401,6 +439,14 @@ private:
     std::list<CNode*> vNodesDisconnected;
     mutable CCriticalSection cs_vNodes;
     std::atomic<NodeId> nLastNodeId;
+    unsigned int nPrevNodeCount;
+    int64_t nLastInactivityCheck;
+#ifdef USE_EPOLL
+    /** epoll instance every listening and node socket is registered with, or -1 to use poll() instead. */
+    int epollfd;
+    /** Nodes whose socket may still have data to read, carried over between socket handler iterations (holding a reference). */
+    std::vector<CNode*> vNodesSocketReady;
+#endif
 
     /** Services this instance offers */
     ServiceFlags nLocalServices;
@@ -425,6 +471,12 @@ private:
     std::mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc;
 
+    /** Received messages waiting for a decode thread, protected by mutexMsgDecode. */
+    int nMsgDecodeThreads;
+    std::deque<std::shared_ptr<CNetMessageDecodeJob>> vMsgDecodeQueue;
+    std::condition_variable condMsgDecode;
+    std::mutex mutexMsgDecode;
+
     CThreadInterrupt interruptNet;
 
     std::thread threadDNSAddressSeed;
@@ -432,6 +484,7 @@ private:
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageDecode;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -471,6 +524,8 @@ public:
     virtual bool SendMessages(CNode* pnode, std::atomic<bool>& interrupt) = 0;
     virtual void InitializeNode(CNode* pnode) = 0;
     virtual void FinalizeNode(NodeId id, bool& update_connection_time) = 0;
+    /** Deserialize a received message ahead of ProcessMessages, called from a decode thread */
+    virtual void DecodeMessage(CNetMessageDecodeJob& job) {}
 };
 
 enum
@@ -538,6 +593,8 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    size_t nSendQueueBytes;
+    size_t nProcessQueueBytes;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -553,6 +610,27 @@ public:
 
 
 
+/**
+ * A received BLOCK or TX message handed to a decode thread. The job holds the message
+ * data (moved out of the CNetMessage, which stays counted in nProcessQueueSize) until the
+ * message handler settles it: whichever of the decode thread and the message handler
+ * takes cs first does so. The handler moves the data back before processing the message,
+ * and falls back to reading it itself if the decode thread has not got to it (or failed
+ * to decode it). Decoding does not consume the data.
+ */
+struct CNetMessageDecodeJob
+{
+    CNetMessageDecodeJob(const std::string& strCommandIn, CDataStream&& vRecvIn) : fDone(false), strCommand(strCommandIn), vRecv(std::move(vRecvIn)) {}
+
+    CCriticalSection cs;
+    bool fDone;
+    const std::string strCommand;
+    CDataStream vRecv;
+    //! Results, only read after fDone is set
+    std::shared_ptr<CBlock> pblock;
+    std::shared_ptr<const CTransaction> ptx;
+};
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
@@ -569,6 +647,8 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
+    std::shared_ptr<CNetMessageDecodeJob> decodeJob; // set if the message was queued for a decode thread
+
     CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
@@ -608,7 +688,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<std::shared_ptr<const std::vector<unsigned char>>> vSendMsg; // buffers may be shared with other nodes' queues
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -660,6 +740,10 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Socket readiness as last reported by the edge-triggered event loop, only used by the socket handler thread
+    bool fSocketRecvReady;
+    bool fSocketSendReady;
+    bool fSocketQueued;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
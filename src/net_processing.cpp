@@ -18,6 +18,7 @@
 #include <netbase.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
+#include <pow.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <random.h>
@@ -30,7 +31,9 @@
 #include <utilmoneystr.h>
 #include <utilstrencodings.h>
 
+#include <list>
 #include <memory>
+#include <tuple>
 
 #if defined(NDEBUG)
 # error "Datacoin cannot be compiled without assertions."
@@ -71,6 +74,21 @@ static const int STALE_RELAY_AGE_LIMIT = 30 * 24 * 60 * 60;
 /// limiting block relay. Set to one week, denominated in seconds.
 static const int HISTORICAL_BLOCK_AGE = 7 * 24 * 60 * 60;
 
+/// Time a peer has to answer a block-announcement GETHEADERS before it is treated
+/// as a legacy client, in seconds.
+static const int64_t HEADERS_SUPPORT_TIMEOUT = 30;
+
+/// Time to wait for the payloads of a "blocktxnd" before requesting the full block
+/// instead, in microseconds.
+static const int64_t DATA_PAYLOAD_TIMEOUT = 10 * 1000000;
+
+/// Most payloads a "blocktxnd" may leave out: each is at least DATA_PAYLOAD_DEFER_SIZE
+/// bytes, so a valid block cannot carry more.
+static const size_t MAX_DEFERRED_PAYLOADS_PER_BLOCK = MAX_BLOCK_SERIALIZED_SIZE / DATA_PAYLOAD_DEFER_SIZE;
+
+/// Memory kept for recently seen data payloads, in bytes.
+static const size_t DATA_PAYLOAD_CACHE_SIZE = 16 * 1024 * 1024;
+
 // Internal stuff
 namespace {
     /** Number of nodes with fSyncStarted. */
@@ -114,6 +132,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When the block was requested (in microseconds).
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -137,8 +156,96 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /** Recently seen large data payloads by Hash(data), oldest first in vDataPayloadsOrder.
+     *  Used to serve MSG_DATA_PAYLOAD requests and to complete "blocktxnd" responses
+     *  without fetching. Protected by cs_main. */
+    typedef std::shared_ptr<const std::vector<unsigned char>> DataPayloadRef;
+    std::map<uint256, DataPayloadRef> mapDataPayloads;
+    std::deque<uint256> vDataPayloadsOrder;
+    size_t nDataPayloadsBytes = 0;
+
+    /** A "blocktxnd" response waiting for some of its deferred payloads. */
+    struct DeferredBlockTransactions {
+        //! The peer the compact block is in flight from, which sent the response
+        NodeId nodeid;
+        int64_t nTimeStarted;
+        //! The response as it will be passed on as "blocktxn", with nullptr for missing transactions
+        BlockTransactions resp;
+        //! The transactions as received, to be completed from their payloads
+        std::vector<PayloadDeferredTransaction> vStubs;
+        //! Payloads still missing, and the indexes in resp.txn that need them
+        std::map<uint256, std::vector<size_t>> mapMissing;
+    };
+    /** Deferred block transactions by block hash, protected by cs_main. */
+    std::map<uint256, DeferredBlockTransactions> mapDeferredBlockTxn;
+    std::atomic<int> nDeferredBlockTxn(0);
+    /** Payloads requested with MSG_DATA_PAYLOAD, and the peer asked. Protected by cs_main. */
+    std::map<uint256, NodeId> mapPayloadsInFlight;
 } // namespace
 
+static void AddDataPayload(const uint256& hash, DataPayloadRef payload) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!mapDataPayloads.emplace(hash, payload).second)
+        return;
+    vDataPayloadsOrder.push_back(hash);
+    nDataPayloadsBytes += payload->size();
+    while (nDataPayloadsBytes > DATA_PAYLOAD_CACHE_SIZE) {
+        auto it = mapDataPayloads.find(vDataPayloadsOrder.front());
+        nDataPayloadsBytes -= it->second->size();
+        mapDataPayloads.erase(it);
+        vDataPayloadsOrder.pop_front();
+    }
+}
+
+/** Make the large payloads of a block's transactions available to peers reconstructing it. */
+static void AddDataPayloads(const std::vector<CTransactionRef>& vtx) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    for (const CTransactionRef& tx : vtx) {
+        if (tx->data.size() >= DATA_PAYLOAD_DEFER_SIZE)
+            AddDataPayload(Hash(tx->data.begin(), tx->data.end()), DataPayloadRef(tx, &tx->data));
+    }
+}
+
+/** Complete the transactions of a pending "blocktxnd" that were waiting for this payload. */
+static void FillDeferredPayload(DeferredBlockTransactions& deferred, const uint256& hash, const std::vector<unsigned char>& payload) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto it = deferred.mapMissing.find(hash);
+    if (it == deferred.mapMissing.end())
+        return;
+    for (size_t i : it->second)
+        deferred.resp.txn[i] = deferred.vStubs[i].WithPayload(payload);
+    deferred.mapMissing.erase(it);
+}
+
+/** Fold a new sample into a smoothed block download statistic. */
+double SmoothBlockDownloadStat(double current, double sample)
+{
+    // Exponentially weighted moving average with weight 1/8, as used for TCP round-trip estimates.
+    return current == 0 ? sample : current + (sample - current) / 8;
+}
+
+/** Blocks to keep in flight to cover the round trip plus BLOCK_DOWNLOAD_TARGET_QUEUE_TIME seconds of transfer. */
+int CalculateMaxBlocksInFlight(double dBlockBytesPerSecond, double dBlockAverageSize, int64_t nBlockLatency)
+{
+    if (dBlockBytesPerSecond <= 0 || dBlockAverageSize <= 0) {
+        return DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+    double dBlocksPerSecond = dBlockBytesPerSecond / dBlockAverageSize;
+    double dTarget = dBlocksPerSecond * (nBlockLatency / 1000000.0 + BLOCK_DOWNLOAD_TARGET_QUEUE_TIME);
+    return std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER, (int)std::min<double>(std::ceil(dTarget), MAX_BLOCKS_IN_TRANSIT_PER_PEER));
+}
+
+/** Whether a block we started waiting for at nWaitingSince is well past what the peer's measurements predict. */
+bool IsBlockRequestOverdue(double dBlockBytesPerSecond, double dBlockAverageSize, int64_t nBlockLatency, int64_t nWaitingSince, int64_t nNow)
+{
+    int64_t nExpected = 0;
+    if (dBlockBytesPerSecond > 0) {
+        nExpected = nBlockLatency + (int64_t)(dBlockAverageSize * 1000000.0 / dBlockBytesPerSecond);
+    }
+    return nNow - nWaitingSince > std::max(BLOCK_DOWNLOAD_REREQUEST_MIN_TIME * 1000000, 2 * nExpected);
+}
+
 namespace {
 
 struct CBlockReject {
@@ -147,6 +254,16 @@ struct CBlockReject {
     uint256 hashBlock;
 };
 
+/** Whether a peer answers GETHEADERS with headers we can connect. */
+enum class HeadersSupport {
+    UNKNOWN,
+    //! Sends full headers: blocks it announces are fetched strictly headers-first.
+    FULL,
+    //! DATACOIN OLDCLIENT: sends headers without bnPrimeChainMultiplier (or none at all),
+    //! so blocks it announces by inv are requested directly.
+    LEGACY,
+};
+
 /**
  * Maintain validation-specific state about nodes, protected by cs_main, instead
  * by CNode's own locks. This simplifies asynchronous operation, where
@@ -187,6 +304,14 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! When we last received a requested full block from this peer (in microseconds), or 0.
+    int64_t nLastBlockDelivery;
+    //! Smoothed rate at which this peer delivers requested blocks, in bytes per second, or 0 if not measured yet.
+    double dBlockBytesPerSecond;
+    //! Smoothed serialized size of the blocks this peer delivered to us.
+    double dBlockAverageSize;
+    //! Smoothed time between requesting a block from an idle queue and its first byte arriving (in microseconds).
+    int64_t nBlockLatency;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -208,6 +333,18 @@ struct CNodeState {
      * otherwise: whether this peer sends non-witnesses in cmpctblocks/blocktxns.
      */
     bool fSupportsDesiredCmpctVersion;
+    //! Whether this peer sent "senddatapay": it takes "blocktxnd" and serves payloads by hash.
+    bool fSupportsDataPayloads;
+    //! Bytes of large transactions we may still announce to this peer (see INVENTORY_LARGE_TX_BURST).
+    int64_t nLargeTxBudget;
+    //! When nLargeTxBudget was last refilled.
+    int64_t nLargeTxBudgetTime;
+    //! Transactions announced to this peer, and how many of those were large (with their total size).
+    uint64_t nTxInvSent;
+    uint64_t nLargeTxInvSent;
+    uint64_t nLargeTxInvBytes;
+    //! Times a large transaction was held back for the next trickle.
+    uint64_t nLargeTxInvDeferred;
 
     /** State used to enforce CHAIN_SYNC_TIMEOUT
       * Only in effect for outbound, non-manual connections, with
@@ -239,6 +376,13 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
+    //! Whether this peer's headers are usable, learned from its GETHEADERS responses.
+    HeadersSupport headersSupport;
+    //! When we sent a GETHEADERS for an inv announcement that is still unanswered (seconds), or 0.
+    int64_t nHeadersRequestTime;
+    //! Last block announced by inv while headersSupport was unknown, fetched if the peer turns out to be legacy.
+    uint256 hashPendingBlockInv;
+
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn) {
         fCurrentlyConnected = false;
         nMisbehavior = 0;
@@ -254,6 +398,10 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nLastBlockDelivery = 0;
+        dBlockBytesPerSecond = 0;
+        dBlockAverageSize = 0;
+        nBlockLatency = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -261,8 +409,18 @@ struct CNodeState {
         fHaveWitness = false;
         fWantsCmpctWitness = false;
         fSupportsDesiredCmpctVersion = false;
+        fSupportsDataPayloads = false;
+        nLargeTxBudget = INVENTORY_LARGE_TX_BURST;
+        nLargeTxBudgetTime = GetTimeMicros();
+        nTxInvSent = 0;
+        nLargeTxInvSent = 0;
+        nLargeTxInvBytes = 0;
+        nLargeTxInvDeferred = 0;
         m_chain_sync = { 0, nullptr, false, false };
         m_last_block_announcement = 0;
+        headersSupport = HeadersSupport::UNKNOWN;
+        nHeadersRequestTime = 0;
+        hashPendingBlockInv.SetNull();
     }
 };
 
@@ -354,7 +512,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -370,6 +528,44 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     return true;
 }
 
+// Requires cs_main.
+// Update the throughput and latency measurements of a peer that just delivered a full block of nBytes bytes we asked it for.
+void UpdateBlockDownloadStats(NodeId nodeid, const uint256& hash, size_t nBytes) {
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid) {
+        // Unsolicited, or requested from someone else: nothing to learn about this peer.
+        return;
+    }
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    const QueuedBlock& queuedBlock = *itInFlight->second.second;
+    int64_t nNow = GetTimeMicros();
+
+    // Blocks are served in the order they were requested, so the link was busy with this block from the
+    // moment the previous one arrived (or this one was requested, whichever is later).
+    int64_t nBusy = std::max<int64_t>(nNow - std::max(state->nLastBlockDelivery, queuedBlock.nTimeRequested), 1);
+    state->dBlockBytesPerSecond = SmoothBlockDownloadStat(state->dBlockBytesPerSecond, nBytes * 1000000.0 / nBusy);
+    state->dBlockAverageSize = SmoothBlockDownloadStat(state->dBlockAverageSize, (double)nBytes);
+
+    // Only a block requested after everything before it was delivered measures the round trip without queueing.
+    if (state->vBlocksInFlight.begin() == itInFlight->second.second && queuedBlock.nTimeRequested >= state->nLastBlockDelivery) {
+        int64_t nTransfer = (int64_t)(nBytes * 1000000.0 / state->dBlockBytesPerSecond);
+        state->nBlockLatency = (int64_t)SmoothBlockDownloadStat(state->nBlockLatency, std::max<int64_t>(nNow - queuedBlock.nTimeRequested - nTransfer, 1));
+    }
+    state->nLastBlockDelivery = nNow;
+}
+
+/** Number of blocks we are willing to have in flight from a peer, sized from its measured throughput and latency. */
+int GetMaxBlocksInFlight(const CNodeState *state) {
+    return CalculateMaxBlocksInFlight(state->dBlockBytesPerSecond, state->dBlockAverageSize, state->nBlockLatency);
+}
+
+/** Whether a block in flight from a peer has taken much longer than that peer's measurements predict. */
+bool IsBlockDownloadOverdue(const CNodeState *state, const QueuedBlock& queuedBlock, int64_t nNow) {
+    return IsBlockRequestOverdue(state->dBlockBytesPerSecond, state->dBlockAverageSize, state->nBlockLatency,
+                                 std::max(state->nLastBlockDelivery, queuedBlock.nTimeRequested), nNow);
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -498,6 +694,10 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     // download that next block if the window were 1 larger.
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
+    // Blocks in flight from other peers near the start of the window hold back the whole download;
+    // if they are overdue there, we take them over when we are faster.
+    int nRerequestEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_REREQUEST_WINDOW;
+    int64_t nNow = GetTimeMicros();
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
@@ -541,9 +741,23 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                 if (vBlocks.size() == count) {
                     return;
                 }
-            } else if (waitingfor == -1) {
-                // This is the first already-in-flight block.
-                waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+            } else {
+                const std::pair<NodeId, std::list<QueuedBlock>::iterator>& inFlight = mapBlocksInFlight[pindex->GetBlockHash()];
+                const CNodeState *stateOwner = State(inFlight.first);
+                if (inFlight.first != nodeid && pindex->nHeight <= nRerequestEnd &&
+                        state->dBlockBytesPerSecond > stateOwner->dBlockBytesPerSecond &&
+                        IsBlockDownloadOverdue(stateOwner, *inFlight.second, nNow)) {
+                    // Stuck on a slower peer; request it from this one instead.
+                    LogPrint(BCLog::NET, "Re-requesting overdue block %s (%d) from peer=%d instead of peer=%d\n",
+                        pindex->GetBlockHash().ToString(), pindex->nHeight, nodeid, inFlight.first);
+                    vBlocks.push_back(pindex);
+                    if (vBlocks.size() == count) {
+                        return;
+                    }
+                } else if (waitingfor == -1) {
+                    // This is the first already-in-flight block.
+                    waitingfor = inFlight.first;
+                }
             }
         }
     }
@@ -595,6 +809,24 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     for (const QueuedBlock& entry : state->vBlocksInFlight) {
         mapBlocksInFlight.erase(entry.hash);
     }
+    for (auto it = mapDeferredBlockTxn.begin(); it != mapDeferredBlockTxn.end(); ) {
+        if (it->second.nodeid == nodeid) {
+            for (const auto& missing : it->second.mapMissing)
+                mapPayloadsInFlight.erase(missing.first);
+            it = mapDeferredBlockTxn.erase(it);
+            nDeferredBlockTxn--;
+        } else {
+            ++it;
+        }
+    }
+    // Payloads asked from this peer for other peers' blocks are asked again by
+    // ProcessDeferredBlockTransactions, from the peer that sent the block
+    for (auto it = mapPayloadsInFlight.begin(); it != mapPayloadsInFlight.end(); ) {
+        if (it->second == nodeid)
+            it = mapPayloadsInFlight.erase(it);
+        else
+            ++it;
+    }
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
@@ -626,6 +858,14 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.dBlockBytesPerSecond = state->dBlockBytesPerSecond;
+    stats.nBlockLatency = state->nBlockLatency;
+    stats.nMaxBlocksInFlight = GetMaxBlocksInFlight(state);
+    stats.nTxInvSent = state->nTxInvSent;
+    stats.nLargeTxInvSent = state->nLargeTxInvSent;
+    stats.nLargeTxInvBytes = state->nLargeTxInvBytes;
+    stats.nLargeTxInvDeferred = state->nLargeTxInvDeferred;
+    stats.nLargeTxBudget = state->nLargeTxBudget;
     return true;
 }
 
@@ -796,9 +1036,178 @@ static bool BlockRequestAllowed(const CBlockIndex* pindex, const Consensus::Para
         (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) < STALE_RELAY_AGE_LIMIT);
 }
 
+// Serialized blocks and transactions recently queued to peers, keyed by (inv type, hash,
+// send version | serialization flags). Only weak references are kept: a payload stays
+// shared for as long as some peer's send queue, the most recent block pin or the block
+// serve cache below still holds it, so e.g. a new block requested by many peers at once
+// is serialized and hashed only once.
+typedef std::tuple<int, uint256, int> SharedPayloadKey;
+static CCriticalSection cs_shared_payloads;
+static std::map<SharedPayloadKey, std::weak_ptr<const CNetMsgPayload>> mapSharedPayloads;
+static size_t nSharedPayloadsSweepSize = 64;
+
+// Size-bounded LRU of serialized blocks and compact blocks near the tip, also protected by
+// cs_shared_payloads. It holds strong references, so getdata bursts for recent blocks (a new
+// peer syncing, many peers catching up after a reorg) are answered without disk reads.
+typedef std::list<std::pair<SharedPayloadKey, CNetMsgPayloadRef>> BlockServeCacheList;
+static BlockServeCacheList lruBlockServeCache;
+static std::map<SharedPayloadKey, BlockServeCacheList::iterator> mapBlockServeCache;
+static size_t nBlockServeCacheBytes = 0;
+static size_t nBlockServeCacheMaxBytes = DEFAULT_BLOCK_SERVE_CACHE_SIZE << 20;
+static uint64_t nBlockServeCacheHits = 0;
+static uint64_t nBlockServeCacheMisses = 0;
+
+static void RetainBlockServePayload(const SharedPayloadKey& key, const CNetMsgPayloadRef& payload) EXCLUSIVE_LOCKS_REQUIRED(cs_shared_payloads)
+{
+    auto it = mapBlockServeCache.find(key);
+    if (it != mapBlockServeCache.end()) {
+        lruBlockServeCache.splice(lruBlockServeCache.begin(), lruBlockServeCache, it->second);
+        return;
+    }
+    if (payload->data.size() > nBlockServeCacheMaxBytes)
+        return;
+    lruBlockServeCache.emplace_front(key, payload);
+    mapBlockServeCache.emplace(key, lruBlockServeCache.begin());
+    nBlockServeCacheBytes += payload->data.size();
+    while (nBlockServeCacheBytes > nBlockServeCacheMaxBytes) {
+        nBlockServeCacheBytes -= lruBlockServeCache.back().second->data.size();
+        mapBlockServeCache.erase(lruBlockServeCache.back().first);
+        lruBlockServeCache.pop_back();
+    }
+}
+
+/** Look up an already serialized block message, counting the lookup in the cache statistics. */
+static CNetMsgPayloadRef GetBlockServePayload(const SharedPayloadKey& key)
+{
+    LOCK(cs_shared_payloads);
+    CNetMsgPayloadRef payload;
+    auto it = mapSharedPayloads.find(key);
+    if (it != mapSharedPayloads.end())
+        payload = it->second.lock();
+    if (payload) {
+        nBlockServeCacheHits++;
+        RetainBlockServePayload(key, payload);
+    } else {
+        nBlockServeCacheMisses++;
+    }
+    return payload;
+}
+
+template <typename T>
+static CNetMsgPayloadRef GetSharedPayload(int nSendVersion, int nFlags, int nType, const uint256& hash, const T& obj, bool fRetain = false)
+{
+    const SharedPayloadKey key(nType, hash, nSendVersion | nFlags);
+    {
+        LOCK(cs_shared_payloads);
+        auto it = mapSharedPayloads.find(key);
+        if (it != mapSharedPayloads.end()) {
+            CNetMsgPayloadRef payload = it->second.lock();
+            if (payload) {
+                if (fRetain)
+                    RetainBlockServePayload(key, payload);
+                return payload;
+            }
+        }
+    }
+
+    CNetMsgPayloadRef payload = CNetMsgMaker(nSendVersion).MakePayload(nFlags, obj);
+
+    LOCK(cs_shared_payloads);
+    mapSharedPayloads[key] = payload;
+    if (fRetain)
+        RetainBlockServePayload(key, payload);
+    if (mapSharedPayloads.size() > nSharedPayloadsSweepSize) {
+        for (auto it = mapSharedPayloads.begin(); it != mapSharedPayloads.end(); ) {
+            if (it->second.expired())
+                it = mapSharedPayloads.erase(it);
+            else
+                ++it;
+        }
+        nSharedPayloadsSweepSize = std::max<size_t>(64, mapSharedPayloads.size() * 2);
+    }
+    return payload;
+}
+
+// Message processing times and block propagation timelines, for getnetstats
+static CCriticalSection cs_net_stats;
+static std::map<std::string, MsgProcessStats> mapMsgProcessStats;
+static std::deque<BlockTimeline> vBlockTimeline;
+
+enum class BlockEvent { INV, HEADERS, CMPCTBLOCK, BLOCK, VALIDATED, CONNECTED };
+
+static void RecordMessageTime(const std::string& strCommand, int64_t nMicros)
+{
+    const std::vector<std::string>& vTypes = getAllNetMessageTypes();
+    const bool fKnown = std::find(vTypes.begin(), vTypes.end(), strCommand) != vTypes.end() || strCommand.compare(0, 7, "decode:") == 0;
+    LOCK(cs_net_stats);
+    MsgProcessStats& stats = mapMsgProcessStats[fKnown ? strCommand : "*other*"];
+    stats.nCount++;
+    stats.nTotalMicros += nMicros;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+    size_t nBucket = 0;
+    while (nBucket < MSG_PROCESS_TIME_BUCKET_COUNT - 1 && nMicros >= MSG_PROCESS_TIME_BUCKETS[nBucket])
+        nBucket++;
+    stats.vBuckets[nBucket]++;
+}
+
+/** Note the first time a block reached a stage. Blocks we have not seen before are only
+ *  added for the stages that can start a timeline. */
+static void RecordBlockEvent(const uint256& hash, BlockEvent event, NodeId nodeid = -1)
+{
+    const int64_t nNow = GetTimeMicros();
+    LOCK(cs_net_stats);
+    auto it = std::find_if(vBlockTimeline.begin(), vBlockTimeline.end(), [&hash](const BlockTimeline& entry) { return entry.hash == hash; });
+    if (it == vBlockTimeline.end()) {
+        if (event == BlockEvent::CONNECTED)
+            return;
+        if (vBlockTimeline.size() >= BLOCK_TIMELINE_SIZE)
+            vBlockTimeline.pop_front();
+        vBlockTimeline.emplace_back();
+        it = vBlockTimeline.end() - 1;
+        it->hash = hash;
+    }
+    int64_t* pTime = nullptr;
+    switch (event) {
+    case BlockEvent::INV: pTime = &it->nFirstInv; break;
+    case BlockEvent::HEADERS: pTime = &it->nFirstHeaders; break;
+    case BlockEvent::CMPCTBLOCK: pTime = &it->nFirstCmpctBlock; break;
+    case BlockEvent::BLOCK: pTime = &it->nBlockReceived; break;
+    case BlockEvent::VALIDATED: pTime = &it->nValidated; break;
+    case BlockEvent::CONNECTED: pTime = &it->nConnected; break;
+    }
+    if (*pTime == 0) {
+        *pTime = nNow;
+        if ((event == BlockEvent::CMPCTBLOCK || event == BlockEvent::BLOCK) && it->nodeFrom == -1)
+            it->nodeFrom = nodeid;
+    }
+}
+
+void GetNetStats(NetStats& stats)
+{
+    {
+        LOCK(cs_net_stats);
+        stats.mapMsgProcess = mapMsgProcessStats;
+        stats.vBlockTimeline.assign(vBlockTimeline.begin(), vBlockTimeline.end());
+    }
+    {
+        LOCK(cs_main);
+        stats.nBlocksInFlight = mapBlocksInFlight.size();
+        stats.nDeferredBlockTxn = mapDeferredBlockTxn.size();
+        stats.nPayloadsInFlight = mapPayloadsInFlight.size();
+    }
+    {
+        LOCK(g_cs_orphans);
+        stats.nOrphanTransactions = mapOrphanTransactions.size();
+    }
+}
+
 PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &scheduler) : connman(connmanIn), m_stale_tip_check_time(0) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    {
+        LOCK(cs_shared_payloads);
+        nBlockServeCacheMaxBytes = std::max<int64_t>(0, gArgs.GetArg("-blockservecachesize", DEFAULT_BLOCK_SERVE_CACHE_SIZE)) << 20;
+    }
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
@@ -810,6 +1219,8 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &schedu
 }
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
+    RecordBlockEvent(pindex->GetBlockHash(), BlockEvent::CONNECTED);
+
     LOCK(g_cs_orphans);
 
     std::vector<uint256> vOrphanErase;
@@ -847,10 +1258,10 @@ static std::shared_ptr<const CBlock> most_recent_block;
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
 static uint256 most_recent_block_hash;
 static bool fWitnessesPresentInMostRecentCompactBlock;
+static CNetMsgPayloadRef most_recent_compact_block_payload;
 
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
-    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
 
@@ -861,34 +1272,68 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
     bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, Params().GetConsensus());
     uint256 hashBlock(pblock->GetHash());
+    // Serialized once here for our own protocol version, which nearly every peer's send version
+    // matches; announcements and getdata replies to those peers share it, the rest share one per
+    // send version
+    CNetMsgPayloadRef payload = GetSharedPayload(PROTOCOL_VERSION, 0, MSG_CMPCT_BLOCK, hashBlock, *pcmpctblock, true);
+
+    AddDataPayloads(pblock->vtx);
+    RecordBlockEvent(hashBlock, BlockEvent::VALIDATED);
 
     {
         LOCK(cs_most_recent_block);
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_compact_block_payload = payload;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
-        // TODO: Avoid the repeated-serialization here
-        if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
+    const bool fLocallyMined = pblock->fLocallyMined;
+    connman->ForEachNode([this, &pcmpctblock, pindex, fWitnessEnabled, fLocallyMined, &hashBlock](CNode* pnode) {
+        const bool fCanCompact = pnode->nVersion >= INVALID_CB_NO_BAN_VERSION;
+        if ((!fCanCompact && !fLocallyMined) || pnode->fDisconnect || !pnode->fSuccessfullyConnected)
             return;
         ProcessBlockAvailability(pnode->GetId());
         CNodeState &state = *State(pnode->GetId());
         // If the peer has, or we announced to them the previous block already,
         // but we don't think they have this one, go ahead and announce it
-        if (state.fPreferHeaderAndIDs && (!fWitnessEnabled || state.fWantsCmpctWitness) &&
+        if (fCanCompact && state.fPreferHeaderAndIDs && (!fWitnessEnabled || state.fWantsCmpctWitness) &&
                 !PeerHasHeader(&state, pindex) && PeerHasHeader(&state, pindex->pprev)) {
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, CNetMsgMaker::MakeFromPayload(NetMsgType::CMPCTBLOCK,
+                GetSharedPayload(pnode->GetSendVersion(), 0, MSG_CMPCT_BLOCK, hashBlock, *pcmpctblock, true)));
+            state.pindexBestHeaderSent = pindex;
+        } else if (fLocallyMined && !PeerHasHeader(&state, pindex)) {
+            // A block we mined: announce it to everyone else now as well, rather than
+            // once it is connected and the peer's SendMessages turn comes up
+            const CNetMsgMaker msgMaker(pnode->GetSendVersion());
+            if (state.fPreferHeaders && PeerHasHeader(&state, pindex->pprev)) {
+                LogPrint(BCLog::NET, "%s sending header %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
+                        hashBlock.ToString(), pnode->GetId());
+                connman->PushMessage(pnode, msgMaker.Make(NetMsgType::HEADERS, std::vector<CBlock>{CBlock(pindex->GetFullBlockHeader())}));
+            } else {
+                LogPrint(BCLog::NET, "%s sending inv %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
+                        hashBlock.ToString(), pnode->GetId());
+                connman->PushMessage(pnode, msgMaker.Make(NetMsgType::INV, std::vector<CInv>{CInv(MSG_BLOCK, hashBlock)}));
+            }
             state.pindexBestHeaderSent = pindex;
         }
     });
 }
 
+void GetBlockServeCacheStats(BlockServeCacheStats& stats)
+{
+    LOCK(cs_shared_payloads);
+    stats.nEntries = lruBlockServeCache.size();
+    stats.nBytes = nBlockServeCacheBytes;
+    stats.nMaxBytes = nBlockServeCacheMaxBytes;
+    stats.nHits = nBlockServeCacheHits;
+    stats.nMisses = nBlockServeCacheMisses;
+}
+
 void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {
     const int nNewHeight = pindexNew->nHeight;
     connman->SetBestHeight(nNewHeight);
@@ -995,6 +1440,22 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+//DATACOIN OLDCLIENT Old clients do not fill bnPrimeChainMultiplier in headers (or do not
+//answer GETHEADERS), so their announcements can only be followed by fetching the block itself.
+static void MarkLegacyHeadersPeer(CNode* pnode, CNodeState* state) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (state->headersSupport != HeadersSupport::LEGACY)
+        LogPrint(BCLog::NET, "peer=%d does not send usable headers, falling back to block requests\n", pnode->GetId());
+    state->headersSupport = HeadersSupport::LEGACY;
+    state->nHeadersRequestTime = 0;
+    if (!state->hashPendingBlockInv.IsNull()) {
+        CInv inv(MSG_BLOCK, state->hashPendingBlockInv);
+        if (!AlreadyHave(inv) && !mapBlocksInFlight.count(inv.hash))
+            pnode->AskFor(inv);
+        state->hashPendingBlockInv.SetNull();
+    }
+}
+
 static void RelayTransaction(const CTransaction& tx, CConnman* connman)
 {
     CInv inv(MSG_TX, tx.GetHash());
@@ -1108,8 +1569,25 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
     // it's available before trying to send.
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
     {
+        // Blocks near the tip are kept serialized, so a hit below is sent without
+        // reading, deserializing or re-serializing anything.
+        const bool fNearTip = mi->second->nHeight >= chainActive.Height() - BLOCK_SERVE_CACHE_DEPTH;
+        const int nSendVersion = pfrom->GetSendVersion();
+        bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+        bool fSendCompact = inv.type == MSG_CMPCT_BLOCK && CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+        // The serialization flags of the block or compact block sent below, which the cache is keyed on
+        int nSendFlags = SERIALIZE_TRANSACTION_NO_WITNESS;
+        if (inv.type == MSG_WITNESS_BLOCK || (inv.type == MSG_CMPCT_BLOCK && fPeerWantsWitness))
+            nSendFlags = 0;
+        CNetMsgPayloadRef payload;
+        if (fNearTip && inv.type != MSG_FILTERED_BLOCK) {
+            payload = GetBlockServePayload(SharedPayloadKey(fSendCompact ? MSG_CMPCT_BLOCK : MSG_BLOCK, inv.hash, nSendVersion | nSendFlags));
+        }
+
         std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
+        if (payload) {
+            connman->PushMessage(pfrom, CNetMsgMaker::MakeFromPayload(fSendCompact ? NetMsgType::CMPCTBLOCK : NetMsgType::BLOCK, payload));
+        } else if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
             pblock = a_recent_block;
         } else {
             // Send block from disk
@@ -1118,10 +1596,10 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
                 assert(!"cannot load block from disk");
             pblock = pblockRead;
         }
-        if (inv.type == MSG_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-        else if (inv.type == MSG_WITNESS_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+        if (payload) {
+            // already sent from the cache
+        } else if (inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK)
+            connman->PushMessage(pfrom, CNetMsgMaker::MakeFromPayload(NetMsgType::BLOCK, GetSharedPayload(nSendVersion, nSendFlags, MSG_BLOCK, inv.hash, *pblock, fNearTip)));
         else if (inv.type == MSG_FILTERED_BLOCK)
         {
             bool sendMerkleBlock = false;
@@ -1154,17 +1632,15 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
             // they won't have a useful mempool to match against a compact block,
             // and we don't feel like constructing the object for them, so
             // instead we respond with the full, non-compact block.
-            bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-            if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+            if (fSendCompact) {
                 if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == mi->second->GetBlockHash()) {
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                    connman->PushMessage(pfrom, CNetMsgMaker::MakeFromPayload(NetMsgType::CMPCTBLOCK, GetSharedPayload(nSendVersion, nSendFlags, MSG_CMPCT_BLOCK, inv.hash, *a_recent_compact_block, fNearTip)));
                 } else {
                     CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                    connman->PushMessage(pfrom, CNetMsgMaker::MakeFromPayload(NetMsgType::CMPCTBLOCK, GetSharedPayload(nSendVersion, nSendFlags, MSG_CMPCT_BLOCK, inv.hash, cmpctblock, fNearTip)));
                 }
             } else {
-                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                connman->PushMessage(pfrom, CNetMsgMaker::MakeFromPayload(NetMsgType::BLOCK, GetSharedPayload(nSendVersion, nSendFlags, MSG_BLOCK, inv.hash, *pblock, fNearTip)));
             }
         }
 
@@ -1192,7 +1668,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     {
         LOCK(cs_main);
 
-        while (it != pfrom->vRecvGetData.end() && (it->type == MSG_TX || it->type == MSG_WITNESS_TX)) {
+        while (it != pfrom->vRecvGetData.end() && (it->type == MSG_TX || it->type == MSG_WITNESS_TX || it->type == MSG_DATA_PAYLOAD)) {
             if (interruptMsgProc)
                 return;
             // Don't bother if send buffer is too full to respond anyway
@@ -1202,12 +1678,21 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             const CInv &inv = *it;
             it++;
 
+            if (inv.type == MSG_DATA_PAYLOAD) {
+                auto mi = mapDataPayloads.find(inv.hash);
+                if (mi != mapDataPayloads.end())
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::PAYLOAD, *mi->second));
+                else
+                    vNotFound.push_back(inv);
+                continue;
+            }
+
             // Send stream from relay memory
             bool push = false;
             auto mi = mapRelay.find(inv.hash);
             int nSendFlags = (inv.type == MSG_TX ? SERIALIZE_TRANSACTION_NO_WITNESS : 0);
             if (mi != mapRelay.end()) {
-                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::TX, *mi->second));
+                connman->PushMessage(pfrom, CNetMsgMaker::MakeFromPayload(NetMsgType::TX, GetSharedPayload(pfrom->GetSendVersion(), nSendFlags, MSG_TX, inv.hash, *mi->second)));
                 push = true;
             } else if (pfrom->timeLastMempoolReq) {
                 auto txinfo = mempool.info(inv.hash);
@@ -1268,9 +1753,55 @@ inline void static SendBlockTransactions(const CBlock& block, const BlockTransac
     LOCK(cs_main);
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
     int nSendFlags = State(pfrom->GetId())->fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+    if (State(pfrom->GetId())->fSupportsDataPayloads) {
+        // Leave large data payloads out; the peer fetches the ones it does not
+        // have by hash, possibly from several peers at once
+        AddDataPayloads(resp.txn);
+        connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXND, BlockTransactionsDeferred(resp)));
+        return;
+    }
     connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
+/**
+ * Request the missing payloads of a "blocktxnd", spread over the peers that support
+ * payload requests and have the block, starting with the peer that sent it.
+ */
+static void RequestDeferredPayloads(CNode* pfrom, const CBlockIndex* pindex, const DeferredBlockTransactions& deferred, CConnman* connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::vector<NodeId> vPeers{pfrom->GetId()};
+    connman->ForEachNode([pfrom, pindex, &vPeers](CNode* pnode) {
+        if (pnode == pfrom || pnode->fDisconnect)
+            return;
+        const CNodeState* state = State(pnode->GetId());
+        if (state->fSupportsDataPayloads && state->pindexBestKnownBlock &&
+                state->pindexBestKnownBlock->GetAncestor(pindex->nHeight) == pindex)
+            vPeers.push_back(pnode->GetId());
+    });
+
+    std::map<NodeId, std::vector<CInv>> mapRequests;
+    size_t nPeer = 0;
+    for (const auto& missing : deferred.mapMissing) {
+        NodeId nodeid = vPeers[nPeer++ % vPeers.size()];
+        mapRequests[nodeid].emplace_back(MSG_DATA_PAYLOAD, missing.first);
+        mapPayloadsInFlight[missing.first] = nodeid;
+    }
+    connman->ForEachNode([&mapRequests, connman](CNode* pnode) {
+        auto it = mapRequests.find(pnode->GetId());
+        if (it == mapRequests.end())
+            return;
+        connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::GETDATA, it->second));
+        mapRequests.erase(it);
+    });
+    // Peers that went away in between: ask the sender
+    for (const auto& request : mapRequests) {
+        for (const CInv& inv : request.second)
+            mapPayloadsInFlight[inv.hash] = pfrom->GetId();
+        connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::GETDATA, request.second));
+    }
+    LogPrint(BCLog::CMPCTBLOCK, "Requesting %u data payloads for block %s from %u peers\n", deferred.mapMissing.size(), deferred.resp.blockhash.ToString(), std::min(vPeers.size(), deferred.mapMissing.size()));
+}
+
 bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::vector<CBlockHeader>& headers, const CChainParams& chainparams, bool punish_duplicate_invalid)
 {
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
@@ -1432,7 +1963,7 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 for (const CBlockIndex *pindex : reverse_iterate(vToFetch)) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= GetMaxBlocksInFlight(nodestate)) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -1490,7 +2021,39 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
     return true;
 }
 
-bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
+void PeerLogicValidation::DecodeMessage(CNetMessageDecodeJob& job)
+{
+    LOCK(job.cs);
+    if (job.fDone)
+        return;
+    try {
+        // Read without consuming, the message handler may still need the data
+        CBufferReader reader(job.vRecv.GetType(), job.vRecv.GetVersion(), job.vRecv.data(), job.vRecv.data() + job.vRecv.size());
+        if (job.strCommand == NetMsgType::BLOCK) {
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            reader >> *pblock;
+            // Both checks only mark the block on success; on failure ProcessNewBlock
+            // repeats them and reports the error as usual.
+            const int64_t nStart = GetTimeMicros();
+            CValidationState state;
+            CheckBlock(*pblock, state, Params().GetConsensus());
+            const int64_t nPoWStart = GetTimeMicros();
+            pblock->fCheckedPoW = CheckProofOfWork(pblock->GetHeaderHash(), pblock->nBits, Params().GetConsensus(), pblock->bnPrimeChainMultiplier, pblock->nPrimeChainType, pblock->nPrimeChainLength, true);
+            RecordMessageTime("decode:block", nPoWStart - nStart);
+            RecordMessageTime("decode:pow", GetTimeMicros() - nPoWStart);
+            job.pblock = std::move(pblock);
+        } else if (job.strCommand == NetMsgType::TX) {
+            CTransactionRef ptx;
+            reader >> ptx;
+            job.ptx = std::move(ptx);
+        }
+    } catch (const std::exception&) {
+        // Leave it to the message handler, which reports malformed messages
+    }
+    job.fDone = true;
+}
+
+bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, const CNetMessageDecodeJob* pdecoded = nullptr)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
     if (gArgs.IsArgSet("-dropmessagestest") && GetRand(gArgs.GetArg("-dropmessagestest", 0)) == 0)
@@ -1778,6 +2341,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
             nCMPCTBLOCKVersion = 1;
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
+            // Offer payload-deferred block transactions; peers that do not know the
+            // message ignore it and keep getting plain "blocktxn"
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDDATAPAY));
         }
         pfrom->fSuccessfullyConnected = true;
     }
@@ -1858,6 +2424,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         State(pfrom->GetId())->fPreferHeaders = true;
     }
 
+    else if (strCommand == NetMsgType::SENDDATAPAY)
+    {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fSupportsDataPayloads = true;
+    }
+
     else if (strCommand == NetMsgType::SENDCMPCT)
     {
         bool fAnnounceUsingCMPCTBLOCK = false;
@@ -1918,6 +2490,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
+                if (!fAlreadyHave) {
+                    RecordBlockEvent(inv.hash, BlockEvent::INV);
+                }
 	            LogPrint(BCLog::NET, "!fAlreadyHave=%d !fImporting=%d !fReindex=%d !mapBlocksInFlight.count(inv.hash)=%d\n", 
 					(int)!fAlreadyHave, (int)!fImporting, (int)!fReindex, (int)!mapBlocksInFlight.count(inv.hash)); //DATACOIN ADDED
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
@@ -1950,7 +2525,15 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 		{
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256())); //DATACOIN OPTIMIZE?
             LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, uint256().ToString(), pfrom->GetId());
-            pfrom->AskFor(*pLastBlockInv);
+            CNodeState *nodestate = State(pfrom->GetId());
+            if (nodestate->nHeadersRequestTime == 0)
+                nodestate->nHeadersRequestTime = GetTime();
+            //DATACOIN OLDCLIENT Only peers whose headers we cannot use get the block requested
+            //directly; for everyone else the headers response drives the download.
+            if (nodestate->headersSupport == HeadersSupport::LEGACY)
+                pfrom->AskFor(*pLastBlockInv);
+            else if (nodestate->headersSupport == HeadersSupport::UNKNOWN)
+                nodestate->hashPendingBlockInv = pLastBlockInv->hash;
 		}
 		
     }
@@ -2165,7 +2748,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         std::deque<COutPoint> vWorkQueue;
         std::vector<uint256> vEraseQueue;
         CTransactionRef ptx;
-        vRecv >> ptx;
+        if (pdecoded && pdecoded->ptx)
+            ptx = pdecoded->ptx;
+        else
+            vRecv >> ptx;
         const CTransaction& tx = *ptx;
 
         CInv inv(MSG_TX, tx.GetHash());
@@ -2343,6 +2929,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     {
         CBlockHeaderAndShortTxIDs cmpctblock;
         vRecv >> cmpctblock;
+        RecordBlockEvent(cmpctblock.header.GetHash(), BlockEvent::CMPCTBLOCK, pfrom->GetId());
 
         bool received_new_header = false;
 
@@ -2438,7 +3025,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // We want to be a bit conservative just to be extra careful about DoS
         // possibilities in compact block processing...
         if (pindex->nHeight <= chainActive.Height() + 2) {
-            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < GetMaxBlocksInFlight(nodestate)) ||
                  (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
                 std::list<QueuedBlock>::iterator* queuedBlockIt = nullptr;
                 if (!MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), pindex, &queuedBlockIt)) {
@@ -2529,6 +3116,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         if (fBlockReconstructed) {
             // If we got here, we were able to optimistically reconstruct a
             // block that is in flight from some other peer.
+            RecordBlockEvent(pblock->GetHash(), BlockEvent::BLOCK, pfrom->GetId());
             {
                 LOCK(cs_main);
                 mapBlockSource.emplace(pblock->GetHash(), std::make_pair(pfrom->GetId(), false));
@@ -2620,6 +3208,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             }
         } // Don't hold cs_main when we call into ProcessNewBlock
         if (fBlockRead) {
+            RecordBlockEvent(pblock->GetHash(), BlockEvent::BLOCK, pfrom->GetId());
             bool fNewBlock = false;
             // Since we requested this block (it was in mapBlocksInFlight), force it to be processed,
             // even if it would not be a candidate for new tip (missing previous block, chain not long enough, etc)
@@ -2638,6 +3227,98 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
+    else if (strCommand == NetMsgType::BLOCKTXND && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactionsDeferred deferredResp;
+        vRecv >> deferredResp;
+
+        BlockTransactions resp;
+        {
+            LOCK(cs_main);
+
+            std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator it = mapBlocksInFlight.find(deferredResp.blockhash);
+            if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                    it->second.first != pfrom->GetId() || mapDeferredBlockTxn.count(deferredResp.blockhash)) {
+                LogPrint(BCLog::NET, "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->GetId());
+                return true;
+            }
+
+            // Check the response against what we asked for before acting on
+            // any payload hash in it, or a peer could make us request made-up
+            // payloads from others.
+            PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
+            size_t nDeferred = 0;
+            for (const PayloadDeferredTransaction& dtx : deferredResp.txn)
+                nDeferred += dtx.IsDeferred();
+            if (deferredResp.txn.size() != partialBlock.MissingTxCount() || nDeferred > MAX_DEFERRED_PAYLOADS_PER_BLOCK) {
+                MarkBlockAsReceived(deferredResp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us a blocktxnd that does not match the transactions we requested\n", pfrom->GetId());
+                return true;
+            }
+
+            DeferredBlockTransactions deferred;
+            deferred.nodeid = pfrom->GetId();
+            deferred.nTimeStarted = GetTimeMicros();
+            deferred.resp.blockhash = deferredResp.blockhash;
+            deferred.resp.txn.resize(deferredResp.txn.size());
+            for (size_t i = 0; i < deferredResp.txn.size(); i++) {
+                const PayloadDeferredTransaction& dtx = deferredResp.txn[i];
+                if (!dtx.IsDeferred()) {
+                    deferred.resp.txn[i] = dtx.tx;
+                } else if (!dtx.tx->data.empty()) {
+                    MarkBlockAsReceived(deferredResp.blockhash); // Reset in-flight state in case of whitelist
+                    Misbehaving(pfrom->GetId(), 100);
+                    LogPrintf("Peer %d sent us a deferred transaction that still has its payload\n", pfrom->GetId());
+                    return true;
+                } else {
+                    auto mi = mapDataPayloads.find(dtx.payloadHash);
+                    if (mi != mapDataPayloads.end())
+                        deferred.resp.txn[i] = dtx.WithPayload(*mi->second);
+                    else
+                        deferred.mapMissing[dtx.payloadHash].push_back(i);
+                }
+            }
+
+            if (!deferred.mapMissing.empty()) {
+                deferred.vStubs = std::move(deferredResp.txn);
+                RequestDeferredPayloads(pfrom, it->second.second->pindex, deferred, connman);
+                mapDeferredBlockTxn.emplace(deferred.resp.blockhash, std::move(deferred));
+                nDeferredBlockTxn++;
+                return true;
+            }
+            resp = std::move(deferred.resp);
+        } // Don't hold cs_main when we call into ProcessNewBlock
+
+        // Every payload was already known: handle it like a plain blocktxn
+        CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
+        blockTxnMsg << resp;
+        return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, chainparams, connman, interruptMsgProc);
+    }
+
+
+    else if (strCommand == NetMsgType::PAYLOAD)
+    {
+        std::vector<unsigned char> data;
+        vRecv >> data;
+        const uint256 hash = Hash(data.begin(), data.end());
+
+        LOCK(cs_main);
+        auto it = mapPayloadsInFlight.find(hash);
+        if (it == mapPayloadsInFlight.end()) {
+            LogPrint(BCLog::NET, "Peer %d sent us a data payload we did not ask for\n", pfrom->GetId());
+            return true;
+        }
+        mapPayloadsInFlight.erase(it);
+
+        DataPayloadRef payload = std::make_shared<const std::vector<unsigned char>>(std::move(data));
+        AddDataPayload(hash, payload);
+        // Completed entries are finished by ProcessDeferredBlockTransactions for their peer
+        for (auto& entry : mapDeferredBlockTxn)
+            FillDeferredPayload(entry.second, hash, *payload);
+    }
+
+
     else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
@@ -2657,13 +3338,28 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
+            LOCK(cs_main);
+            State(pfrom->GetId())->nHeadersRequestTime = 0;
             return true;
         }
+        if (nCount <= MAX_BLOCKS_TO_ANNOUNCE) {
+            for (const CBlockHeader& header : headers)
+                RecordBlockEvent(header.GetHash(), BlockEvent::HEADERS);
+        }
 
         const CBlockIndex *pindexLast = nullptr;
         {
         LOCK(cs_main);
         CNodeState *nodestate = State(pfrom->GetId());
+        nodestate->nHeadersRequestTime = 0;
+        if (headers[0].bnPrimeChainMultiplier == 0)
+            MarkLegacyHeadersPeer(pfrom, nodestate);
+        else if (nodestate->headersSupport != HeadersSupport::FULL) {
+            // Also upgrades peers that were taken for legacy ones, e.g. after a slow GETHEADERS response
+            LogPrint(BCLog::NET, "peer=%d sends full headers, using headers-first block fetching\n", pfrom->GetId());
+            nodestate->headersSupport = HeadersSupport::FULL;
+            nodestate->hashPendingBlockInv.SetNull();
+        }
 
 		LogPrint(BCLog::NET, "headers[0].hashPrevBlock: %s npindexBestHeader->nHeight: %d\n",
                     headers[0].hashPrevBlock.ToString(),
@@ -2810,7 +3506,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 for (const CBlockIndex *pindex : reverse_iterate(vToFetch)) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= GetMaxBlocksInFlight(nodestate)) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -2838,15 +3534,23 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
-        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-        vRecv >> *pblock;
+        std::shared_ptr<CBlock> pblock;
+        const size_t nBlockBytes = vRecv.size();
+        if (pdecoded && pdecoded->pblock) {
+            pblock = pdecoded->pblock;
+        } else {
+            pblock = std::make_shared<CBlock>();
+            vRecv >> *pblock;
+        }
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->GetId());
+        RecordBlockEvent(pblock->GetHash(), BlockEvent::BLOCK, pfrom->GetId());
 
         bool forceProcessing = false;
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
+            UpdateBlockDownloadStats(pfrom->GetId(), hash, nBlockBytes);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
             forceProcessing |= MarkBlockAsReceived(hash);
@@ -3115,8 +3819,31 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
     else if (strCommand == NetMsgType::NOTFOUND) {
-        // We do not care about the NOTFOUND message, but logging an Unknown Command
-        // message would be undesirable as we transmit it ourselves.
+        // We only care about payloads we asked for, and ask the peer that sent us the
+        // block transactions instead; logging an Unknown Command message would be
+        // undesirable as we transmit NOTFOUND ourselves.
+        std::vector<CInv> vInv;
+        vRecv >> vInv;
+        if (vInv.size() <= MAX_INV_SZ) {
+            LOCK(cs_main);
+            for (const CInv& inv : vInv) {
+                if (inv.type != MSG_DATA_PAYLOAD)
+                    continue;
+                auto it = mapPayloadsInFlight.find(inv.hash);
+                if (it == mapPayloadsInFlight.end() || it->second != pfrom->GetId())
+                    continue;
+                for (const auto& entry : mapDeferredBlockTxn) {
+                    if (entry.second.nodeid == pfrom->GetId() || !entry.second.mapMissing.count(inv.hash))
+                        continue;
+                    it->second = entry.second.nodeid;
+                    connman->ForNode(entry.second.nodeid, [connman, &inv](CNode* pnode) {
+                        connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::GETDATA, std::vector<CInv>{inv}));
+                        return true;
+                    });
+                    break;
+                }
+            }
+        }
     }
 
     else {
@@ -3159,9 +3886,80 @@ static bool SendRejectsAndCheckIfBanned(CNode* pnode, CConnman* connman)
     return false;
 }
 
+/**
+ * Pass on the "blocktxnd" responses from this peer whose payloads have all arrived,
+ * and fall back to a full block request for the ones that took too long. Payloads
+ * no longer in flight (the peer asked for them disconnected) are asked from this peer.
+ */
+static void ProcessDeferredBlockTransactions(CNode* pfrom, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
+{
+    if (nDeferredBlockTxn == 0)
+        return;
+
+    std::vector<BlockTransactions> vComplete;
+    std::vector<CInv> vReRequest;
+    {
+        LOCK(cs_main);
+        const int64_t nNow = GetTimeMicros();
+        for (auto it = mapDeferredBlockTxn.begin(); it != mapDeferredBlockTxn.end(); ) {
+            DeferredBlockTransactions& deferred = it->second;
+            if (deferred.nodeid != pfrom->GetId()) {
+                ++it;
+                continue;
+            }
+            if (deferred.mapMissing.empty()) {
+                vComplete.push_back(std::move(deferred.resp));
+            } else if (nNow > deferred.nTimeStarted + DATA_PAYLOAD_TIMEOUT) {
+                LogPrint(BCLog::CMPCTBLOCK, "Timed out fetching %u data payloads for block %s, requesting full block from peer=%d\n", deferred.mapMissing.size(), deferred.resp.blockhash.ToString(), pfrom->GetId());
+                for (const auto& missing : deferred.mapMissing)
+                    mapPayloadsInFlight.erase(missing.first);
+                std::vector<CInv> invs;
+                invs.push_back(CInv(MSG_BLOCK | GetFetchFlags(pfrom), deferred.resp.blockhash));
+                connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::GETDATA, invs));
+            } else {
+                for (const auto& missing : deferred.mapMissing) {
+                    if (mapPayloadsInFlight.emplace(missing.first, pfrom->GetId()).second)
+                        vReRequest.emplace_back(MSG_DATA_PAYLOAD, missing.first);
+                }
+                ++it;
+                continue;
+            }
+            it = mapDeferredBlockTxn.erase(it);
+            nDeferredBlockTxn--;
+        }
+    }
+    if (!vReRequest.empty()) {
+        LogPrint(BCLog::CMPCTBLOCK, "Requesting %u orphaned data payloads from peer=%d\n", vReRequest.size(), pfrom->GetId());
+        connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::GETDATA, vReRequest));
+    }
+
+    for (const BlockTransactions& resp : vComplete) {
+        bool fRet = false;
+        try {
+            CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
+            blockTxnMsg << resp;
+            fRet = ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, GetTimeMicros(), chainparams, connman, interruptMsgProc);
+        } catch (const std::ios_base::failure& e) {
+            connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::REJECT, std::string(NetMsgType::BLOCKTXND), REJECT_MALFORMED, std::string("error parsing message")));
+            LogPrint(BCLog::NET, "%s(%s): Exception '%s' caught\n", __func__, NetMsgType::BLOCKTXND, e.what());
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "ProcessDeferredBlockTransactions()");
+        } catch (...) {
+            PrintExceptionContinue(nullptr, "ProcessDeferredBlockTransactions()");
+        }
+        if (!fRet)
+            LogPrint(BCLog::NET, "%s(%s, block %s) FAILED peer=%d\n", __func__, NetMsgType::BLOCKTXND, resp.blockhash.ToString(), pfrom->GetId());
+    }
+    if (!vComplete.empty()) {
+        LOCK(cs_main);
+        SendRejectsAndCheckIfBanned(pfrom, connman);
+    }
+}
+
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     const CChainParams& chainparams = Params();
+    ProcessDeferredBlockTransactions(pfrom, chainparams, connman, interruptMsgProc);
     //
     // Message format
     //  (4) message start
@@ -3192,13 +3990,25 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
             return false;
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
-        pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        pfrom->nProcessQueueSize -= msgs.front().hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
     CNetMessage& msg(msgs.front());
 
     msg.SetVersion(pfrom->GetRecvVersion());
+    // Settle a pending decode job: use its result if a decode thread finished it,
+    // otherwise claim it so the message is decoded here. Either way take the data back.
+    std::shared_ptr<CNetMessageDecodeJob> decoded;
+    if (msg.decodeJob) {
+        LOCK(msg.decodeJob->cs);
+        if (msg.decodeJob->fDone && msg.decodeJob->vRecv.GetVersion() == msg.vRecv.GetVersion())
+            decoded = msg.decodeJob;
+        msg.decodeJob->fDone = true;
+        msg.vRecv = std::move(msg.decodeJob->vRecv);
+        msg.decodeJob->vRecv.clear();
+        msg.SetVersion(pfrom->GetRecvVersion());
+    }
     // Scan for message start
     if (memcmp(msg.hdr.pchMessageStart, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0) {
         LogPrint(BCLog::NET, "PROCESSMESSAGE: INVALID MESSAGESTART %s peer=%d\n", SanitizeString(msg.hdr.GetCommand()), pfrom->GetId());
@@ -3232,9 +4042,10 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
 
     // Process message
     bool fRet = false;
+    const int64_t nProcessStart = GetTimeMicros();
     try
     {
-        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
+        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc, decoded.get());
         if (interruptMsgProc)
             return false;
         if (!pfrom->vRecvGetData.empty())
@@ -3268,6 +4079,8 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     } catch (...) {
         PrintExceptionContinue(nullptr, "ProcessMessages()");
     }
+    // Messages that threw are timed too, malformed ones can be the expensive ones
+    RecordMessageTime(strCommand, GetTimeMicros() - nProcessStart);
 
     if (!fRet) {
         LogPrint(BCLog::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->GetId());
@@ -3626,7 +4439,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
                             if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+                                connman->PushMessage(pto, CNetMsgMaker::MakeFromPayload(NetMsgType::CMPCTBLOCK, GetSharedPayload(pto->GetSendVersion(), nSendFlags, MSG_CMPCT_BLOCK, most_recent_block_hash, *most_recent_compact_block)));
                             else {
                                 CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
                                 connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
@@ -3770,32 +4583,62 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                 std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
+                // Large (data) transactions have their own limit and are also paced by a
+                // byte budget, so a flood of uploads can't crowd out payments. Once the
+                // next large one doesn't fit, the rest wait for the next trickle too.
                 unsigned int nRelayedTransactions = 0;
+                unsigned int nRelayedLargeTransactions = 0;
+                bool fLargeFull = false;
+                state.nLargeTxBudget = std::min<int64_t>(INVENTORY_LARGE_TX_BURST,
+                    state.nLargeTxBudget + (nNow - state.nLargeTxBudgetTime) * INVENTORY_LARGE_TX_BYTES_PER_SECOND / 1000000);
+                state.nLargeTxBudgetTime = nNow;
                 LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
+                while (!vInvTx.empty()) {
+                    if (nRelayedTransactions >= INVENTORY_BROADCAST_MAX && fLargeFull)
+                        break;
                     // Fetch the top element from the heap
                     std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                     std::set<uint256>::iterator it = vInvTx.back();
                     vInvTx.pop_back();
                     uint256 hash = *it;
-                    // Remove it from the to-be-sent set
-                    pto->setInventoryTxToSend.erase(it);
                     // Check if not in the filter already
                     if (pto->filterInventoryKnown.contains(hash)) {
+                        pto->setInventoryTxToSend.erase(it);
                         continue;
                     }
                     // Not in the mempool anymore? don't bother sending it.
                     auto txinfo = mempool.info(hash);
                     if (!txinfo.tx) {
+                        pto->setInventoryTxToSend.erase(it);
                         continue;
                     }
+                    // Out of room for its class? Keep it for the next trickle.
+                    const size_t nTxSize = txinfo.tx->GetTotalSize();
+                    const bool fLarge = txinfo.tx->data.size() >= DATA_PAYLOAD_DEFER_SIZE;
+                    if (fLarge && !fLargeFull && (nRelayedLargeTransactions >= INVENTORY_BROADCAST_MAX || state.nLargeTxBudget < (int64_t)nTxSize))
+                        fLargeFull = true;
+                    if (fLarge ? fLargeFull : nRelayedTransactions >= INVENTORY_BROADCAST_MAX) {
+                        if (fLarge)
+                            state.nLargeTxInvDeferred++;
+                        continue;
+                    }
+                    // Remove it from the to-be-sent set
+                    pto->setInventoryTxToSend.erase(it);
                     if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
                         continue;
                     }
                     if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
                     // Send
                     vInv.push_back(CInv(MSG_TX, hash));
-                    nRelayedTransactions++;
+                    state.nTxInvSent++;
+                    if (fLarge) {
+                        nRelayedLargeTransactions++;
+                        state.nLargeTxBudget -= nTxSize;
+                        state.nLargeTxInvSent++;
+                        state.nLargeTxInvBytes += nTxSize;
+                    } else {
+                        nRelayedTransactions++;
+                    }
                     {
                         // Expire old relay messages
                         while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
@@ -3885,10 +4728,11 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) { //DATACOIN OLDCLIENT
+        int nMaxBlocksInFlight = GetMaxBlocksInFlight(&state);
+        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nMaxBlocksInFlight) { //DATACOIN OLDCLIENT
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), nMaxBlocksInFlight - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -3907,10 +4751,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         // Message: getdata (non-blocks)
         //
+        if (state.headersSupport == HeadersSupport::UNKNOWN && state.nHeadersRequestTime != 0 && GetTime() > state.nHeadersRequestTime + HEADERS_SUPPORT_TIMEOUT) {
+            MarkLegacyHeadersPeer(pto, &state);
+        }
         while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
         {
             const CInv& inv = (*pto->mapAskFor.begin()).second;
-            if (!AlreadyHave(inv))
+            // Legacy-peer block requests are dropped if the headers path already fetches the block
+            if (!AlreadyHave(inv) && !(inv.type == MSG_BLOCK && mapBlocksInFlight.count(inv.hash)))
             {
                 LogPrint(BCLog::NET, "Requesting %s peer=%d\n", inv.ToString(), pto->GetId());
                 vGetData.push_back(inv);
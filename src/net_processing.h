@@ -34,6 +34,10 @@ static constexpr int64_t STALE_CHECK_INTERVAL = 10 * 60; // 10 minutes
 static constexpr int64_t EXTRA_PEER_CHECK_INTERVAL = 45;
 /** Minimum time an outbound-peer-eviction candidate must be connected for, in order to evict, in seconds */
 static constexpr int64_t MINIMUM_CONNECT_TIME = 30;
+/** Default for -blockservecachesize, memory for serialized recent blocks kept to answer getdata, in megabytes */
+static const unsigned int DEFAULT_BLOCK_SERVE_CACHE_SIZE = 32;
+/** Blocks at most this far below the tip are kept in the serialized block cache */
+static const int BLOCK_SERVE_CACHE_DEPTH = 288;
 
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
@@ -50,6 +54,8 @@ public:
 
     void InitializeNode(CNode* pnode) override;
     void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) override;
+    /** Deserialize a received block or transaction, and run the context-free block checks, off the message handler thread */
+    void DecodeMessage(CNetMessageDecodeJob& job) override;
     /** Process protocol messages received from a given node */
     bool ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt) override;
     /**
@@ -74,10 +80,64 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    double dBlockBytesPerSecond;
+    int64_t nBlockLatency;
+    int nMaxBlocksInFlight;
+    uint64_t nTxInvSent;
+    uint64_t nLargeTxInvSent;
+    uint64_t nLargeTxInvBytes;
+    uint64_t nLargeTxInvDeferred;
+    int64_t nLargeTxBudget;
+};
+
+struct BlockServeCacheStats {
+    size_t nEntries;
+    size_t nBytes;
+    size_t nMaxBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+};
+
+/** Upper bounds of the message processing time histogram buckets, in microseconds; the last bucket is unbounded */
+static const int64_t MSG_PROCESS_TIME_BUCKETS[] = {100, 1000, 10000, 100000, 1000000};
+static const size_t MSG_PROCESS_TIME_BUCKET_COUNT = sizeof(MSG_PROCESS_TIME_BUCKETS) / sizeof(MSG_PROCESS_TIME_BUCKETS[0]) + 1;
+/** Number of recent blocks to keep propagation timelines for */
+static const size_t BLOCK_TIMELINE_SIZE = 32;
+
+struct MsgProcessStats {
+    uint64_t nCount = 0;
+    int64_t nTotalMicros = 0;
+    int64_t nMaxMicros = 0;
+    uint64_t vBuckets[MSG_PROCESS_TIME_BUCKET_COUNT] = {};
+};
+
+/** When we first saw each stage of a block's arrival, in microseconds (0 if not seen) */
+struct BlockTimeline {
+    uint256 hash;
+    NodeId nodeFrom = -1; //! Peer we got the block or compact block from
+    int64_t nFirstInv = 0;
+    int64_t nFirstHeaders = 0;
+    int64_t nFirstCmpctBlock = 0;
+    int64_t nBlockReceived = 0; //! Full block received or reconstructed
+    int64_t nValidated = 0; //! Passed AcceptBlock, before connecting
+    int64_t nConnected = 0;
+};
+
+struct NetStats {
+    std::map<std::string, MsgProcessStats> mapMsgProcess;
+    std::vector<BlockTimeline> vBlockTimeline; //! Oldest first
+    size_t nBlocksInFlight;
+    size_t nDeferredBlockTxn;
+    size_t nPayloadsInFlight;
+    size_t nOrphanTransactions;
 };
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+/** Get usage and hit statistics of the serialized recent block cache */
+void GetBlockServeCacheStats(BlockServeCacheStats& stats);
+/** Get message processing times, block propagation timelines and queue depths */
+void GetNetStats(NetStats& stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
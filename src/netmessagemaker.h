@@ -29,6 +29,23 @@ public:
         return Make(0, std::move(sCommand), std::forward<Args>(args)...);
     }
 
+    /** Serialize args once into a payload that can be sent to several peers with MakeFromPayload. */
+    template <typename... Args>
+    CNetMsgPayloadRef MakePayload(int nFlags, Args&&... args) const
+    {
+        std::vector<unsigned char> data;
+        CVectorWriter{ SER_NETWORK, nFlags | nVersion, data, 0, std::forward<Args>(args)... };
+        return std::make_shared<const CNetMsgPayload>(std::move(data));
+    }
+
+    static CSerializedNetMsg MakeFromPayload(std::string sCommand, CNetMsgPayloadRef payload)
+    {
+        CSerializedNetMsg msg;
+        msg.command = std::move(sCommand);
+        msg.payload = std::move(payload);
+        return msg;
+    }
+
 private:
     const int nVersion;
 };
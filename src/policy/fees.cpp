@@ -61,6 +61,36 @@ bool FeeModeFromString(const std::string& mode_string, FeeEstimateMode& fee_esti
     return true;
 }
 
+FeeEstimateTxClass FeeEstimateTxClassForTx(const CTransaction& tx) {
+    if (tx.data.empty())
+        return FeeEstimateTxClass::PAYMENT;
+    if (tx.data.size() < FEE_ESTIMATE_LARGE_DATA_SIZE)
+        return FeeEstimateTxClass::SMALL_DATA;
+    return FeeEstimateTxClass::LARGE_DATA;
+}
+
+std::string StringForFeeEstimateTxClass(FeeEstimateTxClass tx_class) {
+    static const std::map<FeeEstimateTxClass, std::string> class_strings = {
+        {FeeEstimateTxClass::ALL, "all"},
+        {FeeEstimateTxClass::PAYMENT, "payment"},
+        {FeeEstimateTxClass::SMALL_DATA, "smalldata"},
+        {FeeEstimateTxClass::LARGE_DATA, "largedata"},
+    };
+    auto class_string = class_strings.find(tx_class);
+    if (class_string == class_strings.end()) return "unknown";
+    return class_string->second;
+}
+
+bool FeeEstimateTxClassFromString(const std::string& class_string, FeeEstimateTxClass& tx_class) {
+    for (unsigned int i = 0; i < NUM_FEE_ESTIMATE_TX_CLASSES; i++) {
+        if (class_string == StringForFeeEstimateTxClass((FeeEstimateTxClass)i)) {
+            tx_class = (FeeEstimateTxClass)i;
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * We will instantiate an instance of this class to track transactions that were
  * included in a block. We will lump transactions into a bucket according to their
@@ -514,9 +544,12 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
     LOCK(cs_feeEstimator);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
-        feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        for (FeeEstimateTxClass txClass : {FeeEstimateTxClass::ALL, pos->second.txClass}) {
+            TxClassStats& stats = classStats[(int)txClass];
+            stats.feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+            stats.shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+            stats.longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        }
         mapMemPoolTxs.erase(hash);
         return true;
     } else {
@@ -537,15 +570,21 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     bucketMap[INF_FEERATE] = bucketIndex;
     assert(bucketMap.size() == buckets.size());
 
-    feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
-    shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
-    longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+    for (TxClassStats& stats : classStats)
+        InitClassStats(stats);
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
 {
 }
 
+void CBlockPolicyEstimator::InitClassStats(TxClassStats& stats) const
+{
+    stats.feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
+    stats.shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
+    stats.longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+}
+
 void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
 {
     LOCK(cs_feeEstimator);
@@ -576,13 +615,18 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     // Feerates are stored and reported as per-kb:
     CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
 
-    mapMemPoolTxs[hash].blockHeight = txHeight;
-    unsigned int bucketIndex = feeStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
-    mapMemPoolTxs[hash].bucketIndex = bucketIndex;
-    unsigned int bucketIndex2 = shortStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
-    assert(bucketIndex == bucketIndex2);
-    unsigned int bucketIndex3 = longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
-    assert(bucketIndex == bucketIndex3);
+    TxStatsInfo& info = mapMemPoolTxs[hash];
+    info.blockHeight = txHeight;
+    info.txClass = FeeEstimateTxClassForTx(entry.GetTx());
+    for (FeeEstimateTxClass txClass : {FeeEstimateTxClass::ALL, info.txClass}) {
+        TxClassStats& stats = classStats[(int)txClass];
+        unsigned int bucketIndex = stats.feeStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+        info.bucketIndex = bucketIndex;
+        unsigned int bucketIndex2 = stats.shortStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+        assert(bucketIndex == bucketIndex2);
+        unsigned int bucketIndex3 = stats.longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
+        assert(bucketIndex == bucketIndex3);
+    }
 }
 
 bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
@@ -606,9 +650,12 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     // Feerates are stored and reported as per-kb:
     CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
 
-    feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
-    shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
-    longStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    for (FeeEstimateTxClass txClass : {FeeEstimateTxClass::ALL, FeeEstimateTxClassForTx(entry->GetTx())}) {
+        TxClassStats& stats = classStats[(int)txClass];
+        stats.feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+        stats.shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+        stats.longStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    }
     return true;
 }
 
@@ -630,15 +677,17 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
 
-    // Update unconfirmed circular buffer
-    feeStats->ClearCurrent(nBlockHeight);
-    shortStats->ClearCurrent(nBlockHeight);
-    longStats->ClearCurrent(nBlockHeight);
+    for (TxClassStats& stats : classStats) {
+        // Update unconfirmed circular buffer
+        stats.feeStats->ClearCurrent(nBlockHeight);
+        stats.shortStats->ClearCurrent(nBlockHeight);
+        stats.longStats->ClearCurrent(nBlockHeight);
 
-    // Decay all exponential averages
-    feeStats->UpdateMovingAverages();
-    shortStats->UpdateMovingAverages();
-    longStats->UpdateMovingAverages();
+        // Decay all exponential averages
+        stats.feeStats->UpdateMovingAverages();
+        stats.shortStats->UpdateMovingAverages();
+        stats.longStats->UpdateMovingAverages();
+    }
 
     unsigned int countedTxs = 0;
     // Update averages with data points from current block
@@ -672,20 +721,21 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
 
 CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThreshold, FeeEstimateHorizon horizon, EstimationResult* result) const
 {
+    const TxClassStats& allStats = classStats[(int)FeeEstimateTxClass::ALL];
     TxConfirmStats* stats;
     double sufficientTxs = SUFFICIENT_FEETXS;
     switch (horizon) {
     case FeeEstimateHorizon::SHORT_HALFLIFE: {
-        stats = shortStats.get();
+        stats = allStats.shortStats.get();
         sufficientTxs = SUFFICIENT_TXS_SHORT;
         break;
     }
     case FeeEstimateHorizon::MED_HALFLIFE: {
-        stats = feeStats.get();
+        stats = allStats.feeStats.get();
         break;
     }
     case FeeEstimateHorizon::LONG_HALFLIFE: {
-        stats = longStats.get();
+        stats = allStats.longStats.get();
         break;
     }
     default: {
@@ -710,15 +760,16 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
 
 unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon horizon) const
 {
+    const TxClassStats& allStats = classStats[(int)FeeEstimateTxClass::ALL];
     switch (horizon) {
     case FeeEstimateHorizon::SHORT_HALFLIFE: {
-        return shortStats->GetMaxConfirms();
+        return allStats.shortStats->GetMaxConfirms();
     }
     case FeeEstimateHorizon::MED_HALFLIFE: {
-        return feeStats->GetMaxConfirms();
+        return allStats.feeStats->GetMaxConfirms();
     }
     case FeeEstimateHorizon::LONG_HALFLIFE: {
-        return longStats->GetMaxConfirms();
+        return allStats.longStats->GetMaxConfirms();
     }
     default: {
         throw std::out_of_range("CBlockPolicyEstimator::HighestTargetTracked unknown FeeEstimateHorizon");
@@ -747,39 +798,39 @@ unsigned int CBlockPolicyEstimator::HistoricalBlockSpan() const
 unsigned int CBlockPolicyEstimator::MaxUsableEstimate() const
 {
     // Block spans are divided by 2 to make sure there are enough potential failing data points for the estimate
-    return std::min(longStats->GetMaxConfirms(), std::max(BlockSpan(), HistoricalBlockSpan()) / 2);
+    return std::min(classStats[(int)FeeEstimateTxClass::ALL].longStats->GetMaxConfirms(), std::max(BlockSpan(), HistoricalBlockSpan()) / 2);
 }
 
 /** Return a fee estimate at the required successThreshold from the shortest
  * time horizon which tracks confirmations up to the desired target.  If
  * checkShorterHorizon is requested, also allow short time horizon estimates
  * for a lower target to reduce the given answer */
-double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
+double CBlockPolicyEstimator::estimateCombinedFee(const TxClassStats& stats, unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
 {
     double estimate = -1;
-    if (confTarget >= 1 && confTarget <= longStats->GetMaxConfirms()) {
+    if (confTarget >= 1 && confTarget <= stats.longStats->GetMaxConfirms()) {
         // Find estimate from shortest time horizon possible
-        if (confTarget <= shortStats->GetMaxConfirms()) { // short horizon
-            estimate = shortStats->EstimateMedianVal(confTarget, SUFFICIENT_TXS_SHORT, successThreshold, true, nBestSeenHeight, result);
+        if (confTarget <= stats.shortStats->GetMaxConfirms()) { // short horizon
+            estimate = stats.shortStats->EstimateMedianVal(confTarget, SUFFICIENT_TXS_SHORT, successThreshold, true, nBestSeenHeight, result);
         }
-        else if (confTarget <= feeStats->GetMaxConfirms()) { // medium horizon
-            estimate = feeStats->EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, result);
+        else if (confTarget <= stats.feeStats->GetMaxConfirms()) { // medium horizon
+            estimate = stats.feeStats->EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, result);
         }
         else { // long horizon
-            estimate = longStats->EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, result);
+            estimate = stats.longStats->EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, result);
         }
         if (checkShorterHorizon) {
             EstimationResult tempResult;
             // If a lower confTarget from a more recent horizon returns a lower answer use it.
-            if (confTarget > feeStats->GetMaxConfirms()) {
-                double medMax = feeStats->EstimateMedianVal(feeStats->GetMaxConfirms(), SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, &tempResult);
+            if (confTarget > stats.feeStats->GetMaxConfirms()) {
+                double medMax = stats.feeStats->EstimateMedianVal(stats.feeStats->GetMaxConfirms(), SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, &tempResult);
                 if (medMax > 0 && (estimate == -1 || medMax < estimate)) {
                     estimate = medMax;
                     if (result) *result = tempResult;
                 }
             }
-            if (confTarget > shortStats->GetMaxConfirms()) {
-                double shortMax = shortStats->EstimateMedianVal(shortStats->GetMaxConfirms(), SUFFICIENT_TXS_SHORT, successThreshold, true, nBestSeenHeight, &tempResult);
+            if (confTarget > stats.shortStats->GetMaxConfirms()) {
+                double shortMax = stats.shortStats->EstimateMedianVal(stats.shortStats->GetMaxConfirms(), SUFFICIENT_TXS_SHORT, successThreshold, true, nBestSeenHeight, &tempResult);
                 if (shortMax > 0 && (estimate == -1 || shortMax < estimate)) {
                     estimate = shortMax;
                     if (result) *result = tempResult;
@@ -793,15 +844,15 @@ double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, doubl
 /** Ensure that for a conservative estimate, the DOUBLE_SUCCESS_PCT is also met
  * at 2 * target for any longer time horizons.
  */
-double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const
+double CBlockPolicyEstimator::estimateConservativeFee(const TxClassStats& stats, unsigned int doubleTarget, EstimationResult *result) const
 {
     double estimate = -1;
     EstimationResult tempResult;
-    if (doubleTarget <= shortStats->GetMaxConfirms()) {
-        estimate = feeStats->EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight, result);
+    if (doubleTarget <= stats.shortStats->GetMaxConfirms()) {
+        estimate = stats.feeStats->EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight, result);
     }
-    if (doubleTarget <= feeStats->GetMaxConfirms()) {
-        double longEstimate = longStats->EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight, &tempResult);
+    if (doubleTarget <= stats.feeStats->GetMaxConfirms()) {
+        double longEstimate = stats.longStats->EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight, &tempResult);
         if (longEstimate > estimate) {
             estimate = longEstimate;
             if (result) *result = tempResult;
@@ -817,9 +868,10 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  * estimates, however, required the 95% threshold at 2 * target be met for any
  * longer time horizons also.
  */
-CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative, FeeEstimateTxClass txClass) const
 {
     LOCK(cs_feeEstimator);
+    const TxClassStats& stats = classStats[(int)txClass];
 
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
@@ -830,7 +882,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     EstimationResult tempResult;
 
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms()) {
+    if (confTarget <= 0 || (unsigned int)confTarget > stats.longStats->GetMaxConfirms()) {
         return CFeeRate(0);  // error condition
     }
 
@@ -856,13 +908,13 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
      * the purpose of conservative estimates is not to let short term
      * fluctuations lower our estimates by too much.
      */
-    double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
+    double halfEst = estimateCombinedFee(stats, confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
     if (feeCalc) {
         feeCalc->est = tempResult;
         feeCalc->reason = FeeReason::HALF_ESTIMATE;
     }
     median = halfEst;
-    double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
+    double actualEst = estimateCombinedFee(stats, confTarget, SUCCESS_PCT, true, &tempResult);
     if (actualEst > median) {
         median = actualEst;
         if (feeCalc) {
@@ -870,7 +922,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
             feeCalc->reason = FeeReason::FULL_ESTIMATE;
         }
     }
-    double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
+    double doubleEst = estimateCombinedFee(stats, 2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
     if (doubleEst > median) {
         median = doubleEst;
         if (feeCalc) {
@@ -880,7 +932,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     }
 
     if (conservative || median == -1) {
-        double consEst =  estimateConservativeFee(2 * confTarget, &tempResult);
+        double consEst =  estimateConservativeFee(stats, 2 * confTarget, &tempResult);
         if (consEst > median) {
             median = consEst;
             if (feeCalc) {
@@ -910,9 +962,17 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
             fileout << historicalFirst << historicalBest;
         }
         fileout << buckets;
-        feeStats->Write(fileout);
-        shortStats->Write(fileout);
-        longStats->Write(fileout);
+        const TxClassStats& allStats = classStats[(int)FeeEstimateTxClass::ALL];
+        allStats.feeStats->Write(fileout);
+        allStats.shortStats->Write(fileout);
+        allStats.longStats->Write(fileout);
+        // Per class statistics follow, where older versions stop reading
+        fileout << (uint32_t)(NUM_FEE_ESTIMATE_TX_CLASSES - 1);
+        for (unsigned int i = 1; i < NUM_FEE_ESTIMATE_TX_CLASSES; i++) {
+            classStats[i].feeStats->Write(fileout);
+            classStats[i].shortStats->Write(fileout);
+            classStats[i].longStats->Write(fileout);
+        }
     }
     catch (const std::exception&) {
         LogPrintf("CBlockPolicyEstimator::Write(): unable to write policy estimator data (non-fatal)\n");
@@ -956,6 +1016,26 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             fileShortStats->Read(filein, nVersionThatWrote, numBuckets);
             fileLongStats->Read(filein, nVersionThatWrote, numBuckets);
 
+            TxClassStats fileClassStats[NUM_FEE_ESTIMATE_TX_CLASSES];
+            bool fHaveClassStats = true;
+            uint32_t nFileClasses = 0;
+            try {
+                filein >> nFileClasses;
+            } catch (const std::ios_base::failure&) {
+                // Written before per class statistics were kept
+                fHaveClassStats = false;
+            }
+            if (fHaveClassStats) {
+                if (nFileClasses != NUM_FEE_ESTIMATE_TX_CLASSES - 1)
+                    throw std::runtime_error("Corrupt estimates file. Unexpected number of transaction classes");
+                for (unsigned int i = 1; i < NUM_FEE_ESTIMATE_TX_CLASSES; i++) {
+                    InitClassStats(fileClassStats[i]);
+                    fileClassStats[i].feeStats->Read(filein, nVersionThatWrote, numBuckets);
+                    fileClassStats[i].shortStats->Read(filein, nVersionThatWrote, numBuckets);
+                    fileClassStats[i].longStats->Read(filein, nVersionThatWrote, numBuckets);
+                }
+            }
+
             // Fee estimates file parsed correctly
             // Copy buckets from file and refresh our bucketmap
             buckets = fileBuckets;
@@ -965,9 +1045,18 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             }
 
             // Destroy old TxConfirmStats and point to new ones that already reference buckets and bucketMap
-            feeStats = std::move(fileFeeStats);
-            shortStats = std::move(fileShortStats);
-            longStats = std::move(fileLongStats);
+            TxClassStats& allStats = classStats[(int)FeeEstimateTxClass::ALL];
+            allStats.feeStats = std::move(fileFeeStats);
+            allStats.shortStats = std::move(fileShortStats);
+            allStats.longStats = std::move(fileLongStats);
+            for (unsigned int i = 1; i < NUM_FEE_ESTIMATE_TX_CLASSES; i++) {
+                if (fHaveClassStats) {
+                    classStats[i] = std::move(fileClassStats[i]);
+                } else {
+                    // Start over, sized for the buckets just read
+                    InitClassStats(classStats[i]);
+                }
+            }
 
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
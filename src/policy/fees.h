@@ -18,6 +18,7 @@
 
 class CAutoFile;
 class CFeeRate;
+class CTransaction;
 class CTxMemPoolEntry;
 class CTxMemPool;
 class TxConfirmStats;
@@ -102,6 +103,26 @@ enum class FeeEstimateMode {
 
 bool FeeModeFromString(const std::string& mode_string, FeeEstimateMode& fee_estimate_mode);
 
+/* Classes of transactions which get their own confirmation statistics, as
+ * data uploads confirm quite differently from payments */
+enum class FeeEstimateTxClass {
+    ALL = 0,        //! Every transaction
+    PAYMENT = 1,    //! Transactions without a data payload
+    SMALL_DATA = 2, //! Data payload below FEE_ESTIMATE_LARGE_DATA_SIZE
+    LARGE_DATA = 3, //! Data payload of FEE_ESTIMATE_LARGE_DATA_SIZE or more
+};
+
+static const unsigned int NUM_FEE_ESTIMATE_TX_CLASSES = 4;
+
+/** Data payloads of at least this many bytes are tracked as LARGE_DATA */
+static const unsigned int FEE_ESTIMATE_LARGE_DATA_SIZE = 16 * 1024;
+
+FeeEstimateTxClass FeeEstimateTxClassForTx(const CTransaction& tx);
+
+std::string StringForFeeEstimateTxClass(FeeEstimateTxClass tx_class);
+
+bool FeeEstimateTxClassFromString(const std::string& class_string, FeeEstimateTxClass& tx_class);
+
 /* Used to return detailed information about a feerate bucket */
 struct EstimatorBucket
 {
@@ -209,7 +230,7 @@ public:
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
      */
-    CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
+    CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative, FeeEstimateTxClass txClass = FeeEstimateTxClass::ALL) const;
 
     /** Return a specific fee estimate calculation with a given success
      * threshold and time horizon, and optionally return detailed data about
@@ -239,16 +260,24 @@ private:
     {
         unsigned int blockHeight;
         unsigned int bucketIndex;
-        TxStatsInfo() : blockHeight(0), bucketIndex(0) {}
+        FeeEstimateTxClass txClass;
+        TxStatsInfo() : blockHeight(0), bucketIndex(0), txClass(FeeEstimateTxClass::ALL) {}
     };
 
     // map of txids to information about that transaction
     std::map<uint256, TxStatsInfo> mapMemPoolTxs;
 
     /** Classes to track historical data on transaction confirmations */
-    std::unique_ptr<TxConfirmStats> feeStats;
-    std::unique_ptr<TxConfirmStats> shortStats;
-    std::unique_ptr<TxConfirmStats> longStats;
+    struct TxClassStats
+    {
+        std::unique_ptr<TxConfirmStats> feeStats;
+        std::unique_ptr<TxConfirmStats> shortStats;
+        std::unique_ptr<TxConfirmStats> longStats;
+    };
+
+    /** One set per FeeEstimateTxClass. Every tracked transaction is counted
+     *  in the ALL set and in the set of its own class. */
+    TxClassStats classStats[NUM_FEE_ESTIMATE_TX_CLASSES];
 
     unsigned int trackedTxs;
     unsigned int untrackedTxs;
@@ -258,13 +287,16 @@ private:
 
     mutable CCriticalSection cs_feeEstimator;
 
+    /** Create empty statistics for all horizons */
+    void InitClassStats(TxClassStats& stats) const;
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
 
     /** Helper for estimateSmartFee */
-    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
+    double estimateCombinedFee(const TxClassStats& stats, unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
     /** Helper for estimateSmartFee */
-    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const;
+    double estimateConservativeFee(const TxClassStats& stats, unsigned int doubleTarget, EstimationResult *result) const;
     /** Number of blocks of data recorded while fee estimates have been running */
     unsigned int BlockSpan() const;
     /** Number of blocks of recorded fee estimate data represented in saved data file */
@@ -105,6 +105,8 @@ public:
 
     // memory only
     mutable bool fChecked;
+    mutable bool fCheckedPoW;               // CheckProofOfWork passed and filled in the prime chain fields below
+    mutable bool fLocallyMined;             // found by our miner or pool; announced to all peers as soon as it is valid
     mutable unsigned int nPrimeChainType;   // primecoin: chain type (memory-only)
     mutable unsigned int nPrimeChainLength; // primecoin: chain length (memory-only)
 
@@ -132,6 +134,8 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        fCheckedPoW = false;
+        fLocallyMined = false;
         nPrimeChainType = 0;
         nPrimeChainLength = 0;
     }
@@ -81,10 +81,28 @@ uint256 CTransaction::GetWitnessHash() const
     return SerializeHash(*this, SER_GETHASH, 0);
 }
 
+bool CTransaction::ComputeHasSubCentOutput() const
+{
+    for (const CTxOut& txout : vout) {
+        if (txout.nValue < CENT)
+            return true;
+    }
+    return false;
+}
+
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), data(), hash() {}
-CTransaction::CTransaction(const CMutableTransaction &tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), data(tx.data), hash(ComputeHash()) {}
-CTransaction::CTransaction(CMutableTransaction &&tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), data(tx.data), hash(ComputeHash()) {}
+CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), data(), hash(),
+    nTotalSize(::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION)),
+    nBaseSize(::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)),
+    fHasSubCentOutput(false) {}
+CTransaction::CTransaction(const CMutableTransaction &tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), data(tx.data), hash(ComputeHash()),
+    nTotalSize(::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION)),
+    nBaseSize(::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)),
+    fHasSubCentOutput(ComputeHasSubCentOutput()) {}
+CTransaction::CTransaction(CMutableTransaction &&tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), data(std::move(tx.data)), hash(ComputeHash()),
+    nTotalSize(::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION)),
+    nBaseSize(::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)),
+    fHasSubCentOutput(ComputeHasSubCentOutput()) {}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -97,11 +115,6 @@ CAmount CTransaction::GetValueOut() const
     return nValueOut;
 }
 
-unsigned int CTransaction::GetTotalSize() const
-{
-    return ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
-}
-
 std::string CTransaction::ToString() const
 {
     std::string str;
@@ -127,7 +140,7 @@ int64_t CTransaction::GetMinFee(unsigned int nBlockSize, bool fAllowFree,
     // Base fee is either nMinTxFee or nMinRelayTxFee
     int64_t nBaseFee = (mode == GMF_RELAY) ? nMinRelayTxFee : nMinTxFee;
 
-    unsigned int nBytes = ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
+    unsigned int nBytes = nTotalSize;
     unsigned int nNewBlockSize = nBlockSize + nBytes;
     int64_t nMinFee = (1 + (int64_t)nBytes / 1000) * nBaseFee;
 
@@ -146,12 +159,8 @@ int64_t CTransaction::GetMinFee(unsigned int nBlockSize, bool fAllowFree,
     // This code can be removed after enough miners have upgraded to version 0.9.
     // Until then, be safe when sending and require a fee if any output
     // is less than CENT:
-    if (nMinFee < nBaseFee && mode == GMF_SEND)
-    {
-       for(const CTxOut& txout: vout)
-            if (txout.nValue < CENT)
-                nMinFee = nBaseFee;
-    }
+    if (nMinFee < nBaseFee && mode == GMF_SEND && fHasSubCentOutput)
+        nMinFee = nBaseFee;
 
     // Raise the price as the block approaches full
     if (nBlockSize != 1 && nNewBlockSize >= MAX_BLOCK_SIZE_GEN/2)
@@ -301,8 +301,15 @@ public:
 private:
     /** Memory only. */
     const uint256 hash;
+    /** Serialized size with and without witness data. Memory only, as walking the
+     *  data payload again for every size or fee check is not cheap. */
+    const unsigned int nTotalSize;
+    const unsigned int nBaseSize;
+    /** Whether any output is below CENT, for GetMinFee(GMF_SEND). Memory only. */
+    const bool fHasSubCentOutput;
 
     uint256 ComputeHash() const;
+    bool ComputeHasSubCentOutput() const;
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -347,7 +354,10 @@ public:
      * "Total Size" defined in BIP141 and BIP144.
      * @return Total transaction size in bytes
      */
-    unsigned int GetTotalSize() const;
+    unsigned int GetTotalSize() const { return nTotalSize; }
+
+    /** Get the transaction size in bytes, excluding witness data. */
+    unsigned int GetBaseSize() const { return nBaseSize; }
 
     bool IsCoinBase() const
     {
@@ -243,6 +243,21 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Datacoin: indicates that a node accepts "blocktxnd" in reply to "getblocktxn"
+ * and serves data payloads requested by hash with getdata MSG_DATA_PAYLOAD.
+ */
+extern const char *SENDDATAPAY;
+/**
+ * Datacoin: contains a BlockTransactionsDeferred, a "blocktxn" in which large
+ * data payloads are replaced by their hash, to be fetched separately.
+ */
+extern const char *BLOCKTXND;
+/**
+ * Datacoin: contains a transaction data payload, sent in response to a getdata
+ * for MSG_DATA_PAYLOAD. It is identified by its hash.
+ */
+extern const char *PAYLOAD;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -386,6 +401,7 @@ enum GetDataMsg
     // The following can only occur in getdata. Invs always use TX or BLOCK.
     MSG_FILTERED_BLOCK = 3,  //!< Defined in BIP37
     MSG_CMPCT_BLOCK = 4,     //!< Defined in BIP152
+    MSG_DATA_PAYLOAD = 5,    //!< Datacoin: a transaction's data field, by Hash(data)
     MSG_WITNESS_BLOCK = MSG_BLOCK | MSG_WITNESS_FLAG, //!< Defined in BIP144
     MSG_WITNESS_TX = MSG_TX | MSG_WITNESS_FLAG,       //!< Defined in BIP144
     MSG_FILTERED_WITNESS_BLOCK = MSG_FILTERED_BLOCK | MSG_WITNESS_FLAG,
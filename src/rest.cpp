@@ -11,6 +11,7 @@
 #include <validation.h>
 #include <httpserver.h>
 #include <rpc/blockchain.h>
+#include <rpc/responsecache.h>
 #include <rpc/server.h>
 #include <streams.h>
 #include <sync.h>
@@ -113,6 +114,44 @@ static bool ParseHashStr(const std::string& strReq, uint256& v)
     return true;
 }
 
+/** Map a REST output format to its response cache format */
+static bool GetCacheFormat(RetFormat rf, bool fTx, bool showTxDetails, BlockResponseFormat& format)
+{
+    switch (rf) {
+    case RF_BINARY:
+        format = fTx ? BlockResponseFormat::TX_BINARY : BlockResponseFormat::BLOCK_BINARY;
+        return true;
+    case RF_HEX:
+        format = fTx ? BlockResponseFormat::TX_HEX : BlockResponseFormat::BLOCK_HEX;
+        return true;
+    case RF_JSON:
+        format = fTx ? BlockResponseFormat::TX_JSON_REST :
+            showTxDetails ? BlockResponseFormat::BLOCK_JSON_TXDETAILS : BlockResponseFormat::BLOCK_JSON;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** Reply with a response taken from the cache */
+static bool WriteCachedReply(HTTPRequest* req, RetFormat rf, const std::string& strData)
+{
+    switch (rf) {
+    case RF_BINARY:
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, strData);
+        return true;
+    case RF_HEX:
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strData + "\n");
+        return true;
+    default:
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strData + "\n");
+        return true;
+    }
+}
+
 static bool CheckWarmup(HTTPRequest* req)
 {
     std::string statusmessage;
@@ -208,6 +247,12 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    BlockResponseFormat format;
+    bool fCacheable = GetCacheFormat(rf, false, showTxDetails, format);
+    std::string strCached;
+    if (fCacheable && g_block_response_cache.Get(hash, format, strCached))
+        return WriteCachedReply(req, rf, strCached);
+
     CBlock block;
     CBlockIndex* pblockindex = nullptr;
     {
@@ -229,15 +274,17 @@ static bool rest_block(HTTPRequest* req,
     switch (rf) {
     case RF_BINARY: {
         std::string binaryBlock = ssBlock.str();
+        g_block_response_cache.Put(hash, format, pblockindex, binaryBlock);
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        g_block_response_cache.Put(hash, format, pblockindex, strHex);
         req->WriteHeader("Content-Type", "text/plain");
-        req->WriteReply(HTTP_OK, strHex);
+        req->WriteReply(HTTP_OK, strHex + "\n");
         return true;
     }
 
@@ -247,9 +294,10 @@ static bool rest_block(HTTPRequest* req,
             LOCK(cs_main);
             objBlock = blockToJSON(block, pblockindex, showTxDetails);
         }
-        std::string strJSON = objBlock.write() + "\n";
+        std::string strJSON = objBlock.write();
+        g_block_response_cache.Put(hash, format, pblockindex, strJSON);
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK, strJSON + "\n");
         return true;
     }
 
@@ -350,35 +398,52 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    BlockResponseFormat format;
+    bool fCacheable = GetCacheFormat(rf, true, false, format);
+    std::string strCached;
+    if (fCacheable && g_block_response_cache.Get(hash, format, strCached))
+        return WriteCachedReply(req, rf, strCached);
+
     CTransactionRef tx;
     uint256 hashBlock = uint256();
     if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true))
         return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
+    const CBlockIndex* pindexBlock = nullptr;
+    if (fCacheable && !hashBlock.IsNull()) {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end())
+            pindexBlock = mi->second;
+    }
+
     CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     ssTx << tx;
 
     switch (rf) {
     case RF_BINARY: {
         std::string binaryTx = ssTx.str();
+        g_block_response_cache.Put(hash, format, pindexBlock, binaryTx);
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryTx);
         return true;
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssTx.begin(), ssTx.end()) + "\n";
+        std::string strHex = HexStr(ssTx.begin(), ssTx.end());
+        g_block_response_cache.Put(hash, format, pindexBlock, strHex);
         req->WriteHeader("Content-Type", "text/plain");
-        req->WriteReply(HTTP_OK, strHex);
+        req->WriteReply(HTTP_OK, strHex + "\n");
         return true;
     }
 
     case RF_JSON: {
         UniValue objTx(UniValue::VOBJ);
         TxToUniv(*tx, hashBlock, objTx);
-        std::string strJSON = objTx.write() + "\n";
+        std::string strJSON = objTx.write();
+        g_block_response_cache.Put(hash, format, pindexBlock, strJSON);
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK, strJSON + "\n");
         return true;
     }
 
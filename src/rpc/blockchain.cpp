@@ -16,6 +16,8 @@
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
+#include <rpc/jsonstream.h>
+#include <rpc/responsecache.h>
 #include <rpc/server.h>
 #include <streams.h>
 #include <sync.h>
@@ -36,6 +38,7 @@
 
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
@@ -50,6 +53,12 @@ static std::mutex cs_blockchange;
 static std::condition_variable cond_blockchange;
 static CUpdatedBlock latestblock;
 
+//! Only accessed through std::atomic_load / std::atomic_store
+static std::shared_ptr<const ChainTipSnapshot> g_chain_tip_snapshot;
+static std::atomic<int> nBestHeaderHeight{-1};
+
+static std::shared_ptr<const ChainTipSnapshot> BuildChainTipSnapshot();
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 
 /* Calculate the difficulty for a given block index,
@@ -170,6 +179,29 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+void blockToJSONStream(JSONStreamWriter& stream, const CBlock& block, const UniValue& summary)
+{
+    // Reuse the summary for everything but the transactions, keeping the field order
+    const std::vector<std::string>& keys = summary.getKeys();
+    const std::vector<UniValue>& values = summary.getValues();
+    stream.beginObject();
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] != "tx") {
+            stream.pushKV(keys[i], values[i]);
+            continue;
+        }
+        stream.key("tx");
+        stream.beginArray();
+        for (const auto& tx : block.vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags());
+            stream.value(objTx);
+        }
+        stream.endArray();
+    }
+    stream.endObject();
+}
+
 UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -183,8 +215,7 @@ UniValue getblockcount(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    return GetChainTipSnapshot()->nHeight;
 }
 
 UniValue getbestblockhash(const JSONRPCRequest& request)
@@ -200,20 +231,54 @@ UniValue getbestblockhash(const JSONRPCRequest& request)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetChainTipSnapshot()->hash.GetHex();
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
 {
     if(pindex) {
+        {
+            // Build and publish under cs_main: notifications are delivered
+            // asynchronously, and a slower one must not overwrite a newer tip.
+            LOCK(cs_main);
+            std::atomic_store(&g_chain_tip_snapshot, BuildChainTipSnapshot());
+            if (pindexBestHeader)
+                nBestHeaderHeight = pindexBestHeader->nHeight;
+        }
         std::lock_guard<std::mutex> lock(cs_blockchange);
         latestblock.hash = pindex->GetBlockHash();
         latestblock.height = pindex->nHeight;
+    } else {
+        std::atomic_store(&g_chain_tip_snapshot, std::shared_ptr<const ChainTipSnapshot>());
+        nBestHeaderHeight = -1;
     }
     cond_blockchange.notify_all();
 }
 
+void RPCNotifyHeaderTip(bool ibd, const CBlockIndex * pindex)
+{
+    if (pindex)
+        nBestHeaderHeight = pindex->nHeight;
+}
+
+std::shared_ptr<const ChainTipSnapshot> GetChainTipSnapshot()
+{
+    std::shared_ptr<const ChainTipSnapshot> snapshot = std::atomic_load(&g_chain_tip_snapshot);
+    if (!snapshot)
+        snapshot = BuildChainTipSnapshot();
+    return snapshot;
+}
+
+int GetBestHeaderHeight()
+{
+    int nHeight = nBestHeaderHeight;
+    if (nHeight < 0) {
+        LOCK(cs_main);
+        nHeight = pindexBestHeader ? pindexBestHeader->nHeight : -1;
+    }
+    return nHeight;
+}
+
 UniValue waitfornewblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -364,8 +429,7 @@ UniValue getdifficulty(const JSONRPCRequest& request)
             + HelpExampleRpc("getdifficulty", "")
         );
 
-    LOCK(cs_main);
-    return GetDifficulty();
+    return GetChainTipSnapshot()->dDifficulty;
 }
 
 std::string EntryDescriptionString()
@@ -387,10 +451,19 @@ std::string EntryDescriptionString()
            "       ... ]\n";
 }
 
-void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+/** Unconfirmed transactions e spends from, as sorted hex strings */
+static void entryDepends(const CTxMemPoolEntry &e, std::set<std::string>& setDepends)
 {
     AssertLockHeld(mempool.cs);
+    for (const CTxIn& txin : e.GetTx().vin)
+    {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+}
 
+static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e, const uint256& wtxid, const std::set<std::string>& setDepends)
+{
     info.push_back(Pair("size", (int)e.GetTxSize()));
     info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
     info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
@@ -402,14 +475,7 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
     info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
     info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
-    info.push_back(Pair("wtxid", mempool.vTxHashes[e.vTxHashesIdx].first.ToString()));
-    const CTransaction& tx = e.GetTx();
-    std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
-    {
-        if (mempool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
-    }
+    info.push_back(Pair("wtxid", wtxid.ToString()));
 
     UniValue depends(UniValue::VARR);
     for (const std::string& dep : setDepends)
@@ -420,6 +486,14 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.push_back(Pair("depends", depends));
 }
 
+void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+{
+    AssertLockHeld(mempool.cs);
+    std::set<std::string> setDepends;
+    entryDepends(e, setDepends);
+    entryToJSON(info, e, mempool.vTxHashes[e.vTxHashesIdx].first, setDepends);
+}
+
 UniValue mempoolToJSON(bool fVerbose)
 {
     if (fVerbose)
@@ -448,6 +522,35 @@ UniValue mempoolToJSON(bool fVerbose)
     }
 }
 
+void mempoolToJSONStream(JSONStreamWriter& stream)
+{
+    // Copy the entries, so that mempool.cs is not held while the client reads
+    struct EntrySnapshot {
+        CTxMemPoolEntry entry;
+        uint256 wtxid;
+        std::set<std::string> setDepends;
+    };
+    std::vector<EntrySnapshot> vEntries;
+    {
+        LOCK(mempool.cs);
+        vEntries.reserve(mempool.mapTx.size());
+        for (const CTxMemPoolEntry& e : mempool.mapTx)
+        {
+            vEntries.push_back(EntrySnapshot{e, mempool.vTxHashes[e.vTxHashesIdx].first, std::set<std::string>()});
+            entryDepends(e, vEntries.back().setDepends);
+        }
+    }
+
+    stream.beginObject();
+    for (const EntrySnapshot& snapshot : vEntries)
+    {
+        UniValue info(UniValue::VOBJ);
+        entryToJSON(info, snapshot.entry, snapshot.wtxid, snapshot.setDepends);
+        stream.pushKV(snapshot.entry.GetTx().GetHash().ToString(), info);
+    }
+    stream.endObject();
+}
+
 UniValue getrawmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -477,6 +580,11 @@ UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
+    if (fVerbose && request.stream) {
+        mempoolToJSONStream(*request.stream);
+        return NullUniValue;
+    }
+
     return mempoolToJSON(fVerbose);
 }
 
@@ -777,8 +885,6 @@ UniValue getblock(const JSONRPCRequest& request)
             + HelpExampleRpc("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -790,32 +896,86 @@ UniValue getblock(const JSONRPCRequest& request)
             verbosity = request.params[1].get_bool() ? 1 : 0;
     }
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    // Deep blocks are served from the response cache. Cached JSON can only be
+    // passed on as is through a stream.
+    BlockResponseFormat format = verbosity <= 0 ? BlockResponseFormat::BLOCK_HEX :
+        verbosity == 1 ? BlockResponseFormat::BLOCK_JSON : BlockResponseFormat::BLOCK_JSON_TXDETAILS;
+    if (verbosity <= 0 || request.stream) {
+        std::string strCached;
+        if (g_block_response_cache.Get(hash, format, strCached)) {
+            if (verbosity <= 0)
+                return strCached;
+            request.stream->rawValue(strCached);
+            return NullUniValue;
+        }
+    }
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex;
+    UniValue summary;
+    bool fCacheable;
+    {
+        LOCK(cs_main);
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        // Block not found on disk. This could be because we have the block
-        // header in our index but don't have the block (for example if a
-        // non-whitelisted node sends us an unrequested long chain of valid
-        // blocks, we add the headers to our index, but don't accept the
-        // block).
-        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+        pblockindex = mapBlockIndex[hash];
 
-    if (verbosity <= 0)
-    {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+
+        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+            // Block not found on disk. This could be because we have the block
+            // header in our index but don't have the block (for example if a
+            // non-whitelisted node sends us an unrequested long chain of valid
+            // blocks, we add the headers to our index, but don't accept the
+            // block).
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+
+        if (verbosity <= 0)
+        {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << block;
+            std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+            g_block_response_cache.Put(hash, format, pblockindex, strHex);
+            return strHex;
+        }
+
+        if (!request.stream)
+            return blockToJSON(block, pblockindex, verbosity >= 2);
+
+        // Only the summary needs cs_main; the transactions are written below
+        // without it, so a slow client cannot hold up validation.
+        summary = blockToJSON(block, pblockindex, false);
+        fCacheable = g_block_response_cache.IsCacheable(pblockindex);
+    }
+
+    // Caching builds the whole response in memory; large blocks with
+    // transaction details are streamed instead.
+    if (verbosity >= 2 && fCacheable && ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_RESPONSE_CACHE_TXDETAILS_SIZE)
+        fCacheable = false;
+
+    if (fCacheable) {
+        std::string strJSON;
+        if (verbosity >= 2) {
+            JSONStreamWriter writer([&strJSON](const std::string& chunk) { strJSON += chunk; });
+            blockToJSONStream(writer, block, summary);
+            writer.flush();
+        } else {
+            strJSON = summary.write();
+        }
+        g_block_response_cache.Put(hash, format, pblockindex, strJSON);
+        request.stream->rawValue(strJSON);
+        return NullUniValue;
+    }
+
+    if (verbosity >= 2) {
+        blockToJSONStream(*request.stream, block, summary);
+        return NullUniValue;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    return summary;
 }
 
 struct CCoinsStats
@@ -1159,6 +1319,32 @@ void BIP9SoftForkDescPushBack(UniValue& bip9_softforks, const Consensus::Params&
         bip9_softforks.push_back(Pair(VersionBitsDeploymentInfo[id].name, BIP9SoftForkDesc(consensusParams, id)));
 }
 
+static std::shared_ptr<const ChainTipSnapshot> BuildChainTipSnapshot()
+{
+    LOCK(cs_main);
+    std::shared_ptr<ChainTipSnapshot> snapshot = std::make_shared<ChainTipSnapshot>();
+    CBlockIndex* tip = chainActive.Tip();
+    snapshot->pindex = tip;
+    snapshot->nHeight = chainActive.Height();
+    snapshot->dDifficulty = GetDifficulty();
+    snapshot->nMedianTimePast = tip ? tip->GetMedianTimePast() : 0;
+    snapshot->softforks = UniValue(UniValue::VARR);
+    snapshot->bip9_softforks = UniValue(UniValue::VOBJ);
+    if (tip) {
+        snapshot->hash = tip->GetBlockHash();
+        snapshot->strChainWork = tip->nChainWork.GetHex();
+
+        const Consensus::Params& consensusParams = Params().GetConsensus();
+        snapshot->softforks.push_back(SoftForkDesc("bip34", 2, tip, consensusParams));
+        snapshot->softforks.push_back(SoftForkDesc("bip66", 3, tip, consensusParams));
+        snapshot->softforks.push_back(SoftForkDesc("bip65", 4, tip, consensusParams));
+        for (int pos = Consensus::DEPLOYMENT_CSV; pos != Consensus::MAX_VERSION_BITS_DEPLOYMENTS; ++pos) {
+            BIP9SoftForkDescPushBack(snapshot->bip9_softforks, consensusParams, static_cast<Consensus::DeploymentPos>(pos));
+        }
+    }
+    return snapshot;
+}
+
 UniValue getblockchaininfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -1213,22 +1399,24 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockchaininfo", "")
         );
 
-    LOCK(cs_main);
+    // Chain state comes from the tip snapshot; cs_main is only needed for pruning info
+    std::shared_ptr<const ChainTipSnapshot> tip = GetChainTipSnapshot();
 
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("chain",                 Params().NetworkIDString()));
-    obj.push_back(Pair("blocks",                (int)chainActive.Height()));
-    obj.push_back(Pair("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1));
-    obj.push_back(Pair("bestblockhash",         chainActive.Tip()->GetBlockHash().GetHex()));
-    obj.push_back(Pair("difficulty",            (double)GetDifficulty()));
-    obj.push_back(Pair("mediantime",            (int64_t)chainActive.Tip()->GetMedianTimePast()));
-    obj.push_back(Pair("verificationprogress",  GuessVerificationProgress(Params().TxData(), chainActive.Tip())));
+    obj.push_back(Pair("blocks",                tip->nHeight));
+    obj.push_back(Pair("headers",               GetBestHeaderHeight()));
+    obj.push_back(Pair("bestblockhash",         tip->hash.GetHex()));
+    obj.push_back(Pair("difficulty",            tip->dDifficulty));
+    obj.push_back(Pair("mediantime",            tip->nMedianTimePast));
+    obj.push_back(Pair("verificationprogress",  GuessVerificationProgress(Params().TxData(), tip->pindex)));
     obj.push_back(Pair("initialblockdownload",  IsInitialBlockDownload()));
-    obj.push_back(Pair("chainwork",             chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("chainwork",             tip->strChainWork));
     obj.push_back(Pair("size_on_disk",          CalculateCurrentUsage()));
     obj.push_back(Pair("pruned",                fPruneMode));
     if (fPruneMode) {
-        CBlockIndex* block = chainActive.Tip();
+        LOCK(cs_main);
+        const CBlockIndex* block = tip->pindex;
         assert(block);
         while (block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA)) {
             block = block->pprev;
@@ -1244,18 +1432,8 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
         }
     }
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CBlockIndex* tip = chainActive.Tip();
-    UniValue softforks(UniValue::VARR);
-    UniValue bip9_softforks(UniValue::VOBJ);
-    softforks.push_back(SoftForkDesc("bip34", 2, tip, consensusParams));
-    softforks.push_back(SoftForkDesc("bip66", 3, tip, consensusParams));
-    softforks.push_back(SoftForkDesc("bip65", 4, tip, consensusParams));
-    for (int pos = Consensus::DEPLOYMENT_CSV; pos != Consensus::MAX_VERSION_BITS_DEPLOYMENTS; ++pos) {
-        BIP9SoftForkDescPushBack(bip9_softforks, consensusParams, static_cast<Consensus::DeploymentPos>(pos));
-    }
-    obj.push_back(Pair("softforks",             softforks));
-    obj.push_back(Pair("bip9_softforks", bip9_softforks));
+    obj.push_back(Pair("softforks",             tip->softforks));
+    obj.push_back(Pair("bip9_softforks", tip->bip9_softforks));
 
     obj.push_back(Pair("warnings", GetWarnings("statusbar")));
     return obj;
@@ -1389,6 +1567,10 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
     ret.push_back(Pair("mempoolminfee", ValueFromAmount(std::max(mempool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK())));
     ret.push_back(Pair("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK())));
+    size_t maxmempooldata = gArgs.GetArg("-maxmempooldata", DEFAULT_MAX_MEMPOOL_DATA_SIZE) * 1000000;
+    ret.push_back(Pair("datausage", (int64_t) mempool.GetDataUsage()));
+    ret.push_back(Pair("maxmempooldata", (int64_t) maxmempooldata));
+    ret.push_back(Pair("mempooldataminfee", ValueFromAmount(std::max(mempool.GetDataMinFee(maxmempooldata), ::minRelayTxFee).GetFeePerK())));
 
     return ret;
 }
@@ -1406,7 +1588,10 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee\n"
-            "  \"minrelaytxfee\": xxxxx       (numeric) Current minimum relay fee for transactions\n"
+            "  \"minrelaytxfee\": xxxxx,      (numeric) Current minimum relay fee for transactions\n"
+            "  \"datausage\": xxxxx,          (numeric) Memory usage of transaction data payloads in the mempool\n"
+            "  \"maxmempooldata\": xxxxx,     (numeric) Maximum memory usage for data payloads\n"
+            "  \"mempooldataminfee\": xxxxx   (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for a tx carrying data to be accepted\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -5,9 +5,17 @@
 #ifndef BITCOIN_RPC_BLOCKCHAIN_H
 #define BITCOIN_RPC_BLOCKCHAIN_H
 
+#include <uint256.h>
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+#include <univalue.h>
+
 class CBlock;
 class CBlockIndex;
-class UniValue;
+class JSONStreamWriter;
 
 /**
  * Get the difficulty of the net wrt to the given block index, or the chain tip if
@@ -18,18 +26,55 @@ class UniValue;
  */
 double GetDifficulty(const CBlockIndex* blockindex = nullptr);
 
+/**
+ * Immutable summary of the active chain tip. A new one is published on every
+ * tip change, so read-only RPCs can answer from it without taking cs_main.
+ * Publishing happens under cs_main, so the latest snapshot is never older
+ * than one published before it.
+ */
+struct ChainTipSnapshot
+{
+    //! Tip block index; only its immutable fields may be read without cs_main
+    const CBlockIndex* pindex;
+    uint256 hash;
+    int nHeight;
+    double dDifficulty;
+    int64_t nMedianTimePast;
+    std::string strChainWork;
+    //! Deployment status, as reported by getblockchaininfo
+    UniValue softforks;
+    UniValue bip9_softforks;
+};
+
+/** Latest published chain tip snapshot. When none has been published (RPC
+ *  not started from init), a current one is built under cs_main instead. */
+std::shared_ptr<const ChainTipSnapshot> GetChainTipSnapshot();
+
+/** Height of the best known header, or -1 if unknown */
+int GetBestHeaderHeight();
+
 /** Callback for when block tip changed. */
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 
+/** Callback for when header tip changed. */
+void RPCNotifyHeaderTip(bool ibd, const CBlockIndex *);
+
 /** Block description to JSON */
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 
+/** Block description with transaction details, written one transaction at a time.
+ *  summary is blockToJSON(block, blockindex, false), taken under cs_main. */
+void blockToJSONStream(JSONStreamWriter& stream, const CBlock& block, const UniValue& summary);
+
 /** Mempool information to JSON */
 UniValue mempoolInfoToJSON();
 
 /** Mempool to JSON */
 UniValue mempoolToJSON(bool fVerbose = false);
 
+/** Verbose mempool, written one entry at a time */
+void mempoolToJSONStream(JSONStreamWriter& stream);
+
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
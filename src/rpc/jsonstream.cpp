@@ -0,0 +1,119 @@
+// Copyright (c) 2018 The Datacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/jsonstream.h>
+
+#include <assert.h>
+
+JSONStreamWriter::JSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn) :
+    sink(sinkIn), nChunkSize(nChunkSizeIn), fAfterKey(false), fWritten(false), fFlushed(false)
+{
+    buffer.reserve(nChunkSize);
+}
+
+void JSONStreamWriter::separate()
+{
+    fWritten = true;
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (vFirst.empty())
+        return;
+    if (vFirst.back())
+        vFirst.back() = false;
+    else
+        buffer += ',';
+}
+
+void JSONStreamWriter::maybeFlush()
+{
+    if (buffer.size() >= nChunkSize)
+        flush();
+}
+
+void JSONStreamWriter::flush()
+{
+    if (buffer.empty())
+        return;
+    sink(buffer);
+    buffer.clear();
+    fFlushed = true;
+}
+
+void JSONStreamWriter::beginObject()
+{
+    separate();
+    buffer += '{';
+    vFirst.push_back(true);
+}
+
+void JSONStreamWriter::endObject()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    buffer += '}';
+    maybeFlush();
+}
+
+void JSONStreamWriter::beginArray()
+{
+    separate();
+    buffer += '[';
+    vFirst.push_back(true);
+}
+
+void JSONStreamWriter::endArray()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    buffer += ']';
+    maybeFlush();
+}
+
+void JSONStreamWriter::key(const std::string& strKey)
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    separate();
+    // Let UniValue take care of escaping
+    buffer += UniValue(strKey).write();
+    buffer += ':';
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::rawValue(const std::string& strJSON)
+{
+    separate();
+    if (buffer.size() + strJSON.size() < nChunkSize) {
+        buffer += strJSON;
+        return;
+    }
+    // Large values go to the sink as they are, rather than through the buffer
+    flush();
+    sink(strJSON);
+    fFlushed = true;
+}
+
+void JSONStreamWriter::value(const UniValue& val)
+{
+    if (val.isObject()) {
+        beginObject();
+        const std::vector<std::string>& keys = val.getKeys();
+        const std::vector<UniValue>& values = val.getValues();
+        for (size_t i = 0; i < keys.size(); i++) {
+            key(keys[i]);
+            value(values[i]);
+        }
+        endObject();
+    } else if (val.isArray()) {
+        beginArray();
+        for (const UniValue& elem : val.getValues())
+            value(elem);
+        endArray();
+    } else {
+        separate();
+        buffer += val.write();
+        maybeFlush();
+    }
+}
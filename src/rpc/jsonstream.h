@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The Datacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/** Output is handed to the sink once this many bytes have been buffered */
+static const size_t DEFAULT_JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Incremental JSON emitter for large RPC results.
+ *
+ * Instead of building the whole result as a UniValue tree and serializing it
+ * into one string, a handler opens objects and arrays, and writes keys and
+ * (small) values one at a time. Output is buffered and passed on to the sink
+ * in chunks of roughly nChunkSize bytes, so the full serialized result never
+ * has to exist in memory. Separators are inserted automatically; the caller
+ * is responsible for balancing begin/end calls.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string& chunk)> Sink;
+
+    explicit JSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn = DEFAULT_JSON_STREAM_CHUNK_SIZE);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    /** Write an object key; must be followed by exactly one value or container */
+    void key(const std::string& strKey);
+
+    /** Write a complete value. Arrays and objects are written element by
+     *  element, so chunks can be flushed while large values are emitted. */
+    void value(const UniValue& val);
+
+    /** Write a value that is already serialized JSON */
+    void rawValue(const std::string& strJSON);
+
+    /** Convenience for key() followed by value() */
+    void pushKV(const std::string& strKey, const UniValue& val)
+    {
+        key(strKey);
+        value(val);
+    }
+
+    /** Pass all buffered output to the sink */
+    void flush();
+
+    /** Whether anything has been written yet */
+    bool empty() const { return !fWritten; }
+
+    /** Whether output has already been handed to the sink */
+    bool flushed() const { return fFlushed; }
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string buffer;
+    /** One entry per open container: true until its first element is written */
+    std::vector<bool> vFirst;
+    /** A key was just written, so no separator is needed before the value */
+    bool fAfterKey;
+    bool fWritten;
+    bool fFlushed;
+
+    void separate();
+    void maybeFlush();
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
@@ -8,6 +8,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <consensus/consensus.h>
+#include <consensus/merkle.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
@@ -264,11 +265,8 @@ UniValue getmininginfo(const JSONRPCRequest& request)
             "\nReturns a json object containing mining-related information."
         );
 
-
-    LOCK(cs_main);
-
     UniValue obj(UniValue::VOBJ);
-    obj.push_back(Pair("blocks",           (int)chainActive.Height()));
+    obj.push_back(Pair("blocks",           GetChainTipSnapshot()->nHeight));
     obj.push_back(Pair("blocksperday",  dBlocksPerDay));
     obj.push_back(Pair("chainsperday",  dChainsPerDay));
     obj.push_back(Pair("currentblockweight", (uint64_t)nLastBlockWeight));
@@ -354,6 +352,11 @@ std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     return s;
 }
 
+/** Templates recently returned by getblocktemplate, by template id, so that
+ *  submitprimeheader can complete them. Protected by cs_main. */
+static std::map<uint64_t, std::shared_ptr<const CBlockTemplate>> mapRecentTemplates;
+static const size_t MAX_RECENT_TEMPLATES = 16;
+
 UniValue getblocktemplate(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -392,6 +395,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             "  },\n"
             "  \"vbrequired\" : n,                 (numeric) bit mask of versionbits the server requires set in submissions\n"
             "  \"previousblockhash\" : \"xxxx\",     (string) The hash of current highest block\n"
+            "  \"templateid\" : \"xxxx\",            (string) Identifies this template to submitprimeheader\n"
             "  \"transactions\" : [                (array) contents of non-coinbase transactions that should be included in the next block\n"
             "      {\n"
             "         \"data\" : \"xxxx\",             (string) transaction data encoded in hexadecimal (byte-for-byte)\n"
@@ -567,7 +571,9 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // Update block
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
-    static std::unique_ptr<CBlockTemplate> pblocktemplate;
+    static std::shared_ptr<CBlockTemplate> pblocktemplate;
+    // Bumped whenever pblocktemplate is replaced, to know when cached JSON is stale
+    static uint64_t nTemplateSequence = 0;
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
@@ -592,6 +598,10 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
+        nTemplateSequence++;
+        mapRecentTemplates.emplace(nTemplateSequence, pblocktemplate);
+        while (mapRecentTemplates.size() > MAX_RECENT_TEMPLATES)
+            mapRecentTemplates.erase(mapRecentTemplates.begin());
     }
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -605,42 +615,54 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
     UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
 
-    UniValue transactions(UniValue::VARR);
-    std::map<uint256, int64_t> setTxIndex;
-    int i = 0;
-    for (const auto& it : pblock->vtx) {
-        const CTransaction& tx = *it;
-        uint256 txHash = tx.GetHash();
-        setTxIndex[txHash] = i++;
-
-        if (tx.IsCoinBase())
-            continue;
-
-        UniValue entry(UniValue::VOBJ);
-
-        entry.push_back(Pair("data", EncodeHexTx(tx)));
-        entry.push_back(Pair("txid", txHash.GetHex()));
-        entry.push_back(Pair("hash", tx.GetWitnessHash().GetHex()));
+    // The transaction list only changes with the template, so it is encoded once per
+    // template and shared by every caller (and every woken long-poll) until then;
+    // hex encoding large data transactions is most of the cost of this call
+    static uint64_t nTransactionsSequence = 0;
+    static bool fTransactionsPreSegWit = false;
+    static UniValue transactionsCache(UniValue::VARR);
+    if (nTransactionsSequence != nTemplateSequence || fTransactionsPreSegWit != fPreSegWit) {
+        UniValue& transactions = transactionsCache;
+        transactions.clear();
+        transactions.setArray();
+        std::map<uint256, int64_t> setTxIndex;
+        int i = 0;
+        for (const auto& it : pblock->vtx) {
+            const CTransaction& tx = *it;
+            uint256 txHash = tx.GetHash();
+            setTxIndex[txHash] = i++;
+
+            if (tx.IsCoinBase())
+                continue;
+
+            UniValue entry(UniValue::VOBJ);
+
+            entry.push_back(Pair("data", EncodeHexTx(tx)));
+            entry.push_back(Pair("txid", txHash.GetHex()));
+            entry.push_back(Pair("hash", tx.GetWitnessHash().GetHex()));
+
+            UniValue deps(UniValue::VARR);
+            for (const CTxIn &in : tx.vin)
+            {
+                if (setTxIndex.count(in.prevout.hash))
+                    deps.push_back(setTxIndex[in.prevout.hash]);
+            }
+            entry.push_back(Pair("depends", deps));
+
+            int index_in_template = i - 1;
+            entry.push_back(Pair("fee", pblocktemplate->vTxFees[index_in_template]));
+            int64_t nTxSigOps = pblocktemplate->vTxSigOpsCost[index_in_template];
+            if (fPreSegWit) {
+                assert(nTxSigOps % WITNESS_SCALE_FACTOR == 0);
+                nTxSigOps /= WITNESS_SCALE_FACTOR;
+            }
+            entry.push_back(Pair("sigops", nTxSigOps));
+            entry.push_back(Pair("weight", GetTransactionWeight(tx)));
 
-        UniValue deps(UniValue::VARR);
-        for (const CTxIn &in : tx.vin)
-        {
-            if (setTxIndex.count(in.prevout.hash))
-                deps.push_back(setTxIndex[in.prevout.hash]);
+            transactions.push_back(entry);
         }
-        entry.push_back(Pair("depends", deps));
-
-        int index_in_template = i - 1;
-        entry.push_back(Pair("fee", pblocktemplate->vTxFees[index_in_template]));
-        int64_t nTxSigOps = pblocktemplate->vTxSigOpsCost[index_in_template];
-        if (fPreSegWit) {
-            assert(nTxSigOps % WITNESS_SCALE_FACTOR == 0);
-            nTxSigOps /= WITNESS_SCALE_FACTOR;
-        }
-        entry.push_back(Pair("sigops", nTxSigOps));
-        entry.push_back(Pair("weight", GetTransactionWeight(tx)));
-
-        transactions.push_back(entry);
+        nTransactionsSequence = nTemplateSequence;
+        fTransactionsPreSegWit = fPreSegWit;
     }
 
     UniValue aux(UniValue::VOBJ);
@@ -712,7 +734,8 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     }
 
     result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
-    result.push_back(Pair("transactions", transactions));
+    result.push_back(Pair("templateid", i64tostr(nTemplateSequence)));
+    result.push_back(Pair("transactions", transactionsCache));
     result.push_back(Pair("coinbaseaux", aux));
     result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue));
     result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
@@ -762,35 +785,10 @@ protected:
     }
 };
 
-UniValue submitblock(const JSONRPCRequest& request)
+/** Process a block from submitblock or submitprimeheader and report the result as in BIP22 */
+static UniValue ProcessSubmittedBlock(const std::shared_ptr<CBlock>& blockptr)
 {
-    // We allow 2 arguments for compliance with BIP22. Argument 2 is ignored.
-    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
-        throw std::runtime_error(
-            "submitblock \"hexdata\"  ( \"dummy\" )\n"
-            "\nAttempts to submit new block to network.\n"
-            "See https://en.bitcoin.it/wiki/BIP_0022 for full specification.\n"
-
-            "\nArguments\n"
-            "1. \"hexdata\"        (string, required) the hex-encoded block data to submit\n"
-            "2. \"dummy\"          (optional) dummy value, for compatibility with BIP22. This value is ignored.\n"
-            "\nResult:\n"
-            "\nExamples:\n"
-            + HelpExampleCli("submitblock", "\"mydata\"")
-            + HelpExampleRpc("submitblock", "\"mydata\"")
-        );
-    }
-
-    std::shared_ptr<CBlock> blockptr = std::make_shared<CBlock>();
     CBlock& block = *blockptr;
-    if (!DecodeHexBlk(block, request.params[0].get_str())) {
-        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block decode failed");
-    }
-
-    if (block.vtx.empty() || !block.vtx[0]->IsCoinBase()) {
-        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block does not start with a coinbase");
-    }
-
     uint256 hash = block.GetHash();
     bool fBlockPresent = false;
     {
@@ -833,6 +831,105 @@ UniValue submitblock(const JSONRPCRequest& request)
     return BIP22ValidationResult(sc.state);
 }
 
+UniValue submitblock(const JSONRPCRequest& request)
+{
+    // We allow 2 arguments for compliance with BIP22. Argument 2 is ignored.
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
+        throw std::runtime_error(
+            "submitblock \"hexdata\"  ( \"dummy\" )\n"
+            "\nAttempts to submit new block to network.\n"
+            "See https://en.bitcoin.it/wiki/BIP_0022 for full specification.\n"
+
+            "\nArguments\n"
+            "1. \"hexdata\"        (string, required) the hex-encoded block data to submit\n"
+            "2. \"dummy\"          (optional) dummy value, for compatibility with BIP22. This value is ignored.\n"
+            "\nResult:\n"
+            "\nExamples:\n"
+            + HelpExampleCli("submitblock", "\"mydata\"")
+            + HelpExampleRpc("submitblock", "\"mydata\"")
+        );
+    }
+
+    std::shared_ptr<CBlock> blockptr = std::make_shared<CBlock>();
+    CBlock& block = *blockptr;
+    if (!DecodeHexBlk(block, request.params[0].get_str())) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block decode failed");
+    }
+
+    if (block.vtx.empty() || !block.vtx[0]->IsCoinBase()) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block does not start with a coinbase");
+    }
+
+    return ProcessSubmittedBlock(blockptr);
+}
+
+UniValue submitprimeheader(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 5 || request.params.size() > 6) {
+        throw std::runtime_error(
+            "submitprimeheader \"templateid\" \"coinbase\" ntime nonce \"multiplier\" ( version )\n"
+            "\nSubmits a block found on a getblocktemplate template by its header fields and coinbase,\n"
+            "instead of the whole block. The remaining transactions are taken from the template.\n"
+            "\nArguments\n"
+            "1. \"templateid\"     (string, required) The templateid of a recent getblocktemplate result\n"
+            "2. \"coinbase\"       (string, required) The hex-encoded coinbase transaction, including the extranonce\n"
+            "3. ntime            (numeric, required) The block time\n"
+            "4. nonce            (numeric, required) The block nonce\n"
+            "5. \"multiplier\"     (string, required) The hex-encoded prime chain multiplier\n"
+            "6. version          (numeric, optional) The block version, if changed from the template\n"
+            "\nResult:\n"
+            "null on success, otherwise a string with the reason the block was rejected, as for submitblock\n"
+            "\nExamples:\n"
+            + HelpExampleCli("submitprimeheader", "\"42\" \"01000000010000...\" 1500000000 12345 \"3a1f\"")
+            + HelpExampleRpc("submitprimeheader", "\"42\", \"01000000010000...\", 1500000000, 12345, \"3a1f\"")
+        );
+    }
+
+    uint64_t nTemplateId;
+    if (!ParseUInt64(request.params[0].get_str(), &nTemplateId))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid template id");
+
+    CMutableTransaction mtxCoinbase;
+    if (!DecodeHexTx(mtxCoinbase, request.params[1].get_str(), true))
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Coinbase decode failed");
+    CTransactionRef txCoinbase = MakeTransactionRef(std::move(mtxCoinbase));
+    if (!txCoinbase->IsCoinBase())
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Transaction is not a coinbase");
+
+    const int64_t nTime = request.params[2].get_int64();
+    const int64_t nNonce = request.params[3].get_int64();
+    if (nTime < 0 || nTime > std::numeric_limits<uint32_t>::max() || nNonce < 0 || nNonce > std::numeric_limits<uint32_t>::max())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "ntime and nonce must be 32-bit unsigned values");
+    const std::string strMultiplier = request.params[4].get_str();
+    if (!IsHexNumber(strMultiplier))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "multiplier must be a hex number");
+
+    std::shared_ptr<CBlock> blockptr;
+    {
+        LOCK(cs_main);
+        auto it = mapRecentTemplates.find(nTemplateId);
+        if (it == mapRecentTemplates.end())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown or expired template id");
+        // Copies the transaction references only, not the transactions
+        blockptr = std::make_shared<CBlock>(it->second->block);
+    }
+    CBlock& block = *blockptr;
+    block.vtx[0] = txCoinbase;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    block.nTime = nTime;
+    block.nNonce = nNonce;
+    block.bnPrimeChainMultiplier.SetHex(strMultiplier);
+    if (!request.params[5].isNull())
+        block.nVersion = request.params[5].get_int();
+
+    // The one proof-of-work check; ProcessNewBlock relies on it
+    if (!CheckProofOfWork(block.GetHeaderHash(), block.nBits, Params().GetConsensus(), block.bnPrimeChainMultiplier, block.nPrimeChainType, block.nPrimeChainLength, true))
+        return "high-hash";
+    block.fCheckedPoW = true;
+
+    return ProcessSubmittedBlock(blockptr);
+}
+
 UniValue estimatefee(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -876,9 +973,9 @@ UniValue estimatefee(const JSONRPCRequest& request)
 
 UniValue estimatesmartfee(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
         throw std::runtime_error(
-            "estimatesmartfee conf_target (\"estimate_mode\")\n"
+            "estimatesmartfee conf_target (\"estimate_mode\" \"tx_class\")\n"
             "\nEstimates the approximate fee per kilobyte needed for a transaction to begin\n"
             "confirmation within conf_target blocks if possible and return the number of blocks\n"
             "for which the estimate is valid. Uses virtual transaction size as defined\n"
@@ -894,6 +991,14 @@ UniValue estimatesmartfee(const JSONRPCRequest& request)
             "       \"UNSET\" (defaults to CONSERVATIVE)\n"
             "       \"ECONOMICAL\"\n"
             "       \"CONSERVATIVE\"\n"
+            "3. \"tx_class\"      (string, optional, default=all) Only use the confirmation history of\n"
+            "                   this class of transactions. Must be one of:\n"
+            "       \"all\"\n"
+            "       \"payment\" (no data payload)\n"
+            "       \"smalldata\" (data payload below " + strprintf("%u", FEE_ESTIMATE_LARGE_DATA_SIZE) + " bytes)\n"
+            "       \"largedata\"\n"
+            "                   If there is not enough history for the class, the estimate over all\n"
+            "                   transactions is returned along with an error.\n"
             "\nResult:\n"
             "{\n"
             "  \"feerate\" : x.x,     (numeric, optional) estimate fee rate in " + CURRENCY_UNIT + "/kB\n"
@@ -907,9 +1012,10 @@ UniValue estimatesmartfee(const JSONRPCRequest& request)
             "have been observed to make an estimate for any number of blocks.\n"
             "\nExample:\n"
             + HelpExampleCli("estimatesmartfee", "6")
+            + HelpExampleCli("estimatesmartfee", "6 ECONOMICAL largedata")
             );
 
-    RPCTypeCheck(request.params, {UniValue::VNUM, UniValue::VSTR});
+    RPCTypeCheck(request.params, {UniValue::VNUM, UniValue::VSTR, UniValue::VSTR});
     RPCTypeCheckArgument(request.params[0], UniValue::VNUM);
     unsigned int conf_target = ParseConfirmTarget(request.params[0]);
     bool conservative = true;
@@ -920,13 +1026,27 @@ UniValue estimatesmartfee(const JSONRPCRequest& request)
         }
         if (fee_mode == FeeEstimateMode::ECONOMICAL) conservative = false;
     }
+    FeeEstimateTxClass tx_class = FeeEstimateTxClass::ALL;
+    if (!request.params[2].isNull()) {
+        if (!FeeEstimateTxClassFromString(request.params[2].get_str(), tx_class)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid tx_class parameter");
+        }
+    }
 
     UniValue result(UniValue::VOBJ);
     UniValue errors(UniValue::VARR);
     FeeCalculation feeCalc;
-    CFeeRate feeRate = ::feeEstimator.estimateSmartFee(conf_target, &feeCalc, conservative);
+    CFeeRate feeRate = ::feeEstimator.estimateSmartFee(conf_target, &feeCalc, conservative, tx_class);
+    if (feeRate == CFeeRate(0) && tx_class != FeeEstimateTxClass::ALL) {
+        // Fall back to the history of all transactions
+        feeRate = ::feeEstimator.estimateSmartFee(conf_target, &feeCalc, conservative);
+        if (feeRate != CFeeRate(0)) {
+            errors.push_back("Insufficient data for tx_class " + StringForFeeEstimateTxClass(tx_class) + ", estimate is over all transactions");
+        }
+    }
     if (feeRate != CFeeRate(0)) {
         result.push_back(Pair("feerate", ValueFromAmount(feeRate.GetFeePerK())));
+        if (!errors.empty()) result.push_back(Pair("errors", errors));
     } else {
         errors.push_back("Insufficient data or no feerate found");
         result.push_back(Pair("errors", errors));
@@ -1045,6 +1165,7 @@ static const CRPCCommand commands[] =
     { "mining",             "prioritisetransaction",  &prioritisetransaction,  {"txid","dummy","fee_delta"} },
     { "mining",             "getblocktemplate",       &getblocktemplate,       {"template_request"} },
     { "mining",             "submitblock",            &submitblock,            {"hexdata","dummy"} },
+    { "mining",             "submitprimeheader",      &submitprimeheader,      {"templateid","coinbase","ntime","nonce","multiplier","version"} },
 
     { "mining",             "setgenerate",            &setgenerate,            {"generate", "genproclimit"} },
     { "mining",             "getsievesize",           &getsievesize,           {} },
@@ -1058,7 +1179,7 @@ static const CRPCCommand commands[] =
     { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries"} },
 
     { "util",               "estimatefee",            &estimatefee,            {"nblocks"} },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode", "tx_class"} },
 
     { "hidden",             "estimaterawfee",         &estimaterawfee,         {"conf_target", "threshold"} },
 };
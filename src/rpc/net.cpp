@@ -101,6 +101,16 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"blockrate\": n,           (numeric) Measured rate at which the peer delivers requested blocks, in bytes per second\n"
+            "    \"blocklatency\": n,        (numeric) Measured block request latency in seconds\n"
+            "    \"maxinflight\": n,         (numeric) Number of blocks we are currently willing to have in flight from the peer\n"
+            "    \"txrelay\": {               (json object) Transaction announcements to the peer\n"
+            "       \"invsent\": n,           (numeric) Transactions announced\n"
+            "       \"largeinvsent\": n,      (numeric) Large (data) transactions announced, paced by a byte budget\n"
+            "       \"largeinvbytes\": n,     (numeric) Total size of the large transactions announced\n"
+            "       \"largedeferred\": n,     (numeric) Times a large transaction was held back for the next trickle\n"
+            "       \"largebudget\": n        (numeric) Bytes of large transactions that may currently be announced\n"
+            "    },\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -167,6 +177,16 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("blockrate", statestats.dBlockBytesPerSecond));
+            obj.push_back(Pair("blocklatency", statestats.nBlockLatency / 1e6));
+            obj.push_back(Pair("maxinflight", statestats.nMaxBlocksInFlight));
+            UniValue txrelay(UniValue::VOBJ);
+            txrelay.push_back(Pair("invsent", statestats.nTxInvSent));
+            txrelay.push_back(Pair("largeinvsent", statestats.nLargeTxInvSent));
+            txrelay.push_back(Pair("largeinvbytes", statestats.nLargeTxInvBytes));
+            txrelay.push_back(Pair("largedeferred", statestats.nLargeTxInvDeferred));
+            txrelay.push_back(Pair("largebudget", statestats.nLargeTxBudget));
+            obj.push_back(Pair("txrelay", txrelay));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -392,6 +412,132 @@ UniValue getnettotals(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getnetstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getnetstats\n"
+            "\nReturns profiling information about message processing, network queues and\n"
+            "the propagation of recent blocks.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"messages\": {                (json object) Processing time by message type, since startup\n"
+            "    \"block\": {\n"
+            "      \"count\": n,              (numeric) Number of messages processed\n"
+            "      \"total\": n,              (numeric) Total processing time in milliseconds\n"
+            "      \"max\": n,                (numeric) Longest processing time in milliseconds\n"
+            "      \"histogram\": [n,...]     (numeric) Message counts with processing times below 0.1, 1, 10, 100 and 1000 ms, and above\n"
+            "    },\n"
+            "    ...                          (\"decode:block\" and \"decode:pow\" time the block checks on decode threads)\n"
+            "  },\n"
+            "  \"queues\": {\n"
+            "    \"decode\": n,               (numeric) Received messages waiting for a decode thread\n"
+            "    \"blocksinflight\": n,       (numeric) Blocks requested from peers\n"
+            "    \"deferredblocktxn\": n,     (numeric) Compact blocks waiting for data payloads\n"
+            "    \"payloadsinflight\": n,     (numeric) Data payloads requested from peers\n"
+            "    \"orphans\": n               (numeric) Orphan transactions\n"
+            "  },\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,                 (numeric) Peer index\n"
+            "      \"sendqueue\": n,          (numeric) Bytes queued for sending\n"
+            "      \"processqueue\": n,       (numeric) Bytes received and waiting to be processed\n"
+            "      \"inflight\": n            (numeric) Blocks requested from this peer\n"
+            "    },\n"
+            "    ...\n"
+            "  ],\n"
+            "  \"blocks\": [                  (json array) Recent blocks, oldest first\n"
+            "    {\n"
+            "      \"hash\": \"hash\",          (string) The block hash\n"
+            "      \"firstseen\": n,          (numeric) When we first heard of the block, in seconds since epoch (Jan 1 1970 GMT)\n"
+            "      \"peer\": n,               (numeric) The peer we received the block from, if any\n"
+            "      \"inv\": n,                (numeric) Milliseconds after firstseen of the first inv, if any\n"
+            "      \"headers\": n,            (numeric) Same for the first headers announcement\n"
+            "      \"cmpctblock\": n,         (numeric) Same for the first compact block\n"
+            "      \"block\": n,              (numeric) Same for receiving or reconstructing the full block\n"
+            "      \"validated\": n,          (numeric) Same for passing validation, before connecting\n"
+            "      \"connected\": n           (numeric) Same for connecting the block\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetstats", "")
+            + HelpExampleRpc("getnetstats", "")
+       );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    NetStats netstats;
+    GetNetStats(netstats);
+
+    UniValue messages(UniValue::VOBJ);
+    for (const auto& entry : netstats.mapMsgProcess) {
+        const MsgProcessStats& stats = entry.second;
+        UniValue msg(UniValue::VOBJ);
+        msg.push_back(Pair("count", stats.nCount));
+        msg.push_back(Pair("total", stats.nTotalMicros / 1e3));
+        msg.push_back(Pair("max", stats.nMaxMicros / 1e3));
+        UniValue histogram(UniValue::VARR);
+        for (uint64_t nBucket : stats.vBuckets)
+            histogram.push_back(nBucket);
+        msg.push_back(Pair("histogram", histogram));
+        messages.push_back(Pair(entry.first, msg));
+    }
+
+    UniValue queues(UniValue::VOBJ);
+    queues.push_back(Pair("decode", (uint64_t)g_connman->GetMsgDecodeQueueSize()));
+    queues.push_back(Pair("blocksinflight", (uint64_t)netstats.nBlocksInFlight));
+    queues.push_back(Pair("deferredblocktxn", (uint64_t)netstats.nDeferredBlockTxn));
+    queues.push_back(Pair("payloadsinflight", (uint64_t)netstats.nPayloadsInFlight));
+    queues.push_back(Pair("orphans", (uint64_t)netstats.nOrphanTransactions));
+
+    std::vector<CNodeStats> vstats;
+    g_connman->GetNodeStats(vstats);
+    UniValue peers(UniValue::VARR);
+    for (const CNodeStats& stats : vstats) {
+        UniValue peer(UniValue::VOBJ);
+        peer.push_back(Pair("id", stats.nodeid));
+        peer.push_back(Pair("sendqueue", (uint64_t)stats.nSendQueueBytes));
+        peer.push_back(Pair("processqueue", (uint64_t)stats.nProcessQueueBytes));
+        CNodeStateStats statestats;
+        if (GetNodeStateStats(stats.nodeid, statestats))
+            peer.push_back(Pair("inflight", (uint64_t)statestats.vHeightInFlight.size()));
+        peers.push_back(peer);
+    }
+
+    UniValue blocks(UniValue::VARR);
+    for (const BlockTimeline& timeline : netstats.vBlockTimeline) {
+        const std::pair<const char*, int64_t> vStages[] = {
+            {"inv", timeline.nFirstInv}, {"headers", timeline.nFirstHeaders},
+            {"cmpctblock", timeline.nFirstCmpctBlock}, {"block", timeline.nBlockReceived},
+            {"validated", timeline.nValidated}, {"connected", timeline.nConnected},
+        };
+        int64_t nFirstSeen = std::numeric_limits<int64_t>::max();
+        for (const auto& stage : vStages) {
+            if (stage.second)
+                nFirstSeen = std::min(nFirstSeen, stage.second);
+        }
+        UniValue block(UniValue::VOBJ);
+        block.push_back(Pair("hash", timeline.hash.GetHex()));
+        block.push_back(Pair("firstseen", nFirstSeen / 1e6));
+        if (timeline.nodeFrom != -1)
+            block.push_back(Pair("peer", timeline.nodeFrom));
+        for (const auto& stage : vStages) {
+            if (stage.second)
+                block.push_back(Pair(stage.first, (stage.second - nFirstSeen) / 1e3));
+        }
+        blocks.push_back(block);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("messages", messages));
+    obj.push_back(Pair("queues", queues));
+    obj.push_back(Pair("peers", peers));
+    obj.push_back(Pair("blocks", blocks));
+    return obj;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -449,6 +595,15 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
             "  }\n"
             "  ,...\n"
             "  ]\n"
+            "  \"blockservecache\": {                   (json object) serialized recent blocks kept for serving peers\n"
+            "    \"entries\": xxx,                      (numeric) number of cached blocks and compact blocks\n"
+            "    \"bytes\": xxx,                        (numeric) memory used by cached payloads\n"
+            "    \"maxbytes\": xxx,                     (numeric) configured limit (-blockservecachesize)\n"
+            "    \"hits\": xxx,                         (numeric) block requests answered from the cache\n"
+            "    \"misses\": xxx,                       (numeric) block requests near the tip not found in the cache, and so\n"
+            "                                           serialized again (from the most recent block in memory, or from disk)\n"
+            "    \"hitrate\": x.xxx                     (numeric) hits / (hits + misses)\n"
+            "  }\n"
             "  \"warnings\": \"...\"                    (string) any network and blockchain warnings\n"
             "}\n"
             "\nExamples:\n"
@@ -485,6 +640,17 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
         }
     }
     obj.push_back(Pair("localaddresses", localAddresses));
+    BlockServeCacheStats cachestats;
+    GetBlockServeCacheStats(cachestats);
+    UniValue blockServeCache(UniValue::VOBJ);
+    blockServeCache.push_back(Pair("entries", (uint64_t)cachestats.nEntries));
+    blockServeCache.push_back(Pair("bytes", (uint64_t)cachestats.nBytes));
+    blockServeCache.push_back(Pair("maxbytes", (uint64_t)cachestats.nMaxBytes));
+    blockServeCache.push_back(Pair("hits", cachestats.nHits));
+    blockServeCache.push_back(Pair("misses", cachestats.nMisses));
+    uint64_t nLookups = cachestats.nHits + cachestats.nMisses;
+    blockServeCache.push_back(Pair("hitrate", nLookups ? (double)cachestats.nHits / nLookups : 0.0));
+    obj.push_back(Pair("blockservecache", blockServeCache));
     obj.push_back(Pair("warnings",       GetWarnings("statusbar")));
     return obj;
 }
@@ -711,6 +877,7 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       {"node"} },
     { "network",            "getnettotals",           &getnettotals,           {} },
+    { "network",            "getnetstats",            &getnetstats,            {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         {} },
     { "network",            "setban",                 &setban,                 {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             {} },
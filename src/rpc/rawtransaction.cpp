@@ -17,6 +17,8 @@
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <primitives/transaction.h>
+#include <rpc/jsonstream.h>
+#include <rpc/responsecache.h>
 #include <rpc/safemode.h>
 #include <rpc/server.h>
 #include <script/script.h>
@@ -141,8 +143,6 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
             + HelpExampleCli("getrawtransaction", "\"mytxid\" true \"myblockhash\"")
         );
 
-    LOCK(cs_main);
-
     bool in_active_chain = true;
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
     CBlockIndex* blockindex = nullptr;
@@ -158,6 +158,22 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
         fVerbose = request.params[1].isNum() ? (request.params[1].get_int() != 0) : request.params[1].get_bool();
     }
 
+    // Transactions in deep blocks are served from the response cache, except
+    // when a block hash is given, as that adds "in_active_chain".
+    BlockResponseFormat format = fVerbose ? BlockResponseFormat::TX_JSON : BlockResponseFormat::TX_HEX;
+    bool fCacheable = request.params[2].isNull() && (!fVerbose || request.stream);
+    if (fCacheable) {
+        std::string strCached;
+        if (g_block_response_cache.Get(hash, format, strCached)) {
+            if (!fVerbose)
+                return strCached;
+            request.stream->rawValue(strCached);
+            return NullUniValue;
+        }
+    }
+
+    LOCK(cs_main);
+
     if (!request.params[2].isNull()) {
         uint256 blockhash = ParseHashV(request.params[2], "parameter 3");
         BlockMap::iterator it = mapBlockIndex.find(blockhash);
@@ -185,13 +201,29 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, errmsg + ". Use gettransaction for wallet transactions.");
     }
 
+    const CBlockIndex* pindexCache = nullptr;
+    if (fCacheable && !hash_block.IsNull()) {
+        BlockMap::iterator mi = mapBlockIndex.find(hash_block);
+        if (mi != mapBlockIndex.end() && g_block_response_cache.IsCacheable(mi->second))
+            pindexCache = mi->second;
+    }
+
     if (!fVerbose) {
-        return EncodeHexTx(*tx, RPCSerializationFlags());
+        std::string strHex = EncodeHexTx(*tx, RPCSerializationFlags());
+        if (pindexCache)
+            g_block_response_cache.Put(hash, format, pindexCache, strHex);
+        return strHex;
     }
 
     UniValue result(UniValue::VOBJ);
     if (blockindex) result.push_back(Pair("in_active_chain", in_active_chain));
     TxToJSON(*tx, hash_block, result);
+    if (pindexCache) {
+        std::string strJSON = result.write();
+        g_block_response_cache.Put(hash, format, pindexCache, strJSON);
+        request.stream->rawValue(strJSON);
+        return NullUniValue;
+    }
     return result;
 }
 
@@ -1034,6 +1066,129 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+/** Most transactions sendrawtransactions takes at once, as it holds cs_main for the whole batch */
+static const size_t MAX_SENDRAWTRANSACTIONS_BATCH = 1000;
+
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "The batch is validated under a single lock with scripts verified in parallel, and\n"
+            "transactions are accepted in order, so later ones may spend earlier ones.\n"
+            "\nArguments:\n"
+            "1. [\"hexstring\",...]  (array, required) The hex strings of the raw transactions, at most 1000\n"
+            "2. allowhighfees        (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                       (array) One object per transaction, in the order given\n"
+            "  {\n"
+            "    \"txid\": \"hash\",       (string) The transaction hash in hex\n"
+            "    \"accepted\": true|false, (boolean) Whether the transaction is in the mempool\n"
+            "    \"error\": \"text\"       (string, optional) Why the transaction was rejected\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "'[\"signedhex\",\"signedhex2\"]'") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex2\"]")
+        );
+
+    ObserveSafeMode();
+
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    const UniValue& hexs = request.params[0].get_array();
+    if (hexs.size() > MAX_SENDRAWTRANSACTIONS_BATCH)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many transactions, at most %u per call", MAX_SENDRAWTRANSACTIONS_BATCH));
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(hexs.size());
+    for (size_t i = 0; i < hexs.size(); i++) {
+        CMutableTransaction mtx;
+        if (!hexs[i].isStr() || !DecodeHexTx(mtx, hexs[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (!request.params[1].isNull() && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    // Drop transactions already in the chain, as sendrawtransaction does; the
+    // batch reports those already in the mempool as accepted
+    std::vector<std::string> vError(vtx.size());
+    std::vector<bool> vAccepted(vtx.size(), false);
+    std::vector<CTransactionRef> vtxNew;
+    std::vector<size_t> vNewIndex;
+    {
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (size_t i = 0; i < vtx.size(); i++) {
+            const uint256& hashTx = vtx[i]->GetHash();
+            bool fHaveChain = false;
+            for (size_t o = 0; !fHaveChain && o < vtx[i]->vout.size(); o++) {
+                const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+                fHaveChain = !existingCoin.IsSpent();
+            }
+            if (fHaveChain) {
+                vError[i] = "transaction already in block chain";
+            } else {
+                vtxNew.push_back(vtx[i]);
+                vNewIndex.push_back(i);
+            }
+        }
+    }
+
+    std::vector<CValidationState> vstate;
+    std::vector<bool> vMissingInputs;
+    AcceptToMemoryPoolBatch(mempool, vtxNew, vstate, vMissingInputs, nMaxRawTxFee);
+    for (size_t j = 0; j < vtxNew.size(); j++) {
+        const size_t i = vNewIndex[j];
+        if (vstate[j].IsValid()) {
+            vAccepted[i] = true;
+        } else if (vstate[j].IsInvalid()) {
+            vError[i] = strprintf("%i: %s", vstate[j].GetRejectCode(), vstate[j].GetRejectReason());
+        } else if (vMissingInputs[j]) {
+            vError[i] = "Missing inputs";
+        } else {
+            vError[i] = vstate[j].GetRejectReason();
+        }
+    }
+
+    // One wait for the wallet callbacks of the whole batch (see sendrawtransaction)
+    std::promise<void> promise;
+    CallFunctionInValidationInterfaceQueue([&promise] {
+        promise.set_value();
+    });
+    promise.get_future().wait();
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    std::vector<CInv> vInv;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vAccepted[i])
+            vInv.emplace_back(MSG_TX, vtx[i]->GetHash());
+    }
+    g_connman->ForEachNode([&vInv](CNode* pnode)
+    {
+        for (const CInv& inv : vInv)
+            pnode->PushInventory(inv);
+    });
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", vtx[i]->GetHash().GetHex()));
+        entry.push_back(Pair("accepted", (bool)vAccepted[i]));
+        if (!vAccepted[i])
+            entry.push_back(Pair("error", vError[i]));
+        result.push_back(entry);
+    }
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1042,6 +1197,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   {"hexstring","iswitness"} },
     { "rawtransactions",    "decodescript",           &decodescript,           {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  {"txs"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
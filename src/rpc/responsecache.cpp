@@ -0,0 +1,205 @@
+// Copyright (c) 2018 The Datacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/responsecache.h>
+
+#include <chain.h>
+#include <memusage.h>
+#include <rpc/blockchain.h>
+#include <utilstrencodings.h>
+
+static const std::string CONFIRMATIONS_KEY = "\"confirmations\":";
+static const std::string NEXTBLOCKHASH_KEY = ",\"nextblockhash\":\"";
+
+CBlockResponseCache g_block_response_cache;
+
+/** Whether the block at nHeight with hash hashBlock is in the tip's chain with at least nMinDepth confirmations */
+static bool IsBuriedInChain(const ChainTipSnapshot& tip, const uint256& hashBlock, int nHeight, int nMinDepth)
+{
+    if (!tip.pindex || nHeight < 0 || tip.nHeight - nHeight + 1 < nMinDepth)
+        return false;
+    const CBlockIndex* pindex = tip.pindex->GetAncestor(nHeight);
+    return pindex && pindex->GetBlockHash() == hashBlock;
+}
+
+static bool HasConfirmations(BlockResponseFormat format)
+{
+    return format == BlockResponseFormat::BLOCK_JSON ||
+           format == BlockResponseFormat::BLOCK_JSON_TXDETAILS ||
+           format == BlockResponseFormat::TX_JSON;
+}
+
+static bool HasNextBlockHash(BlockResponseFormat format)
+{
+    return format == BlockResponseFormat::BLOCK_JSON ||
+           format == BlockResponseFormat::BLOCK_JSON_TXDETAILS;
+}
+
+CBlockResponseCache::CBlockResponseCache() :
+    nUsage(0), nMaxUsage((size_t)DEFAULT_BLOCK_RESPONSE_CACHE_SIZE << 20), nMinDepth(DEFAULT_BLOCK_RESPONSE_CACHE_DEPTH)
+{
+}
+
+size_t CBlockResponseCache::EntryUsage(const Entry& entry)
+{
+    // list node, index node and the string buffer
+    return memusage::MallocUsage(sizeof(Entry) + 2 * sizeof(void*)) +
+           memusage::MallocUsage(sizeof(memusage::stl_tree_node<std::pair<const Key, std::list<Entry>::iterator> >)) +
+           memusage::MallocUsage(entry.strData.capacity());
+}
+
+void CBlockResponseCache::Erase(std::map<Key, std::list<Entry>::iterator>::iterator it)
+{
+    nUsage -= EntryUsage(*it->second);
+    lru.erase(it->second);
+    index.erase(it);
+}
+
+void CBlockResponseCache::SetLimits(size_t nMaxUsageIn, int nMinDepthIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    nMinDepth = nMinDepthIn;
+    while (nUsage > nMaxUsage && !lru.empty())
+        Erase(index.find(lru.back().key));
+}
+
+bool CBlockResponseCache::IsCacheable(const CBlockIndex* pindexBlock) const
+{
+    if (!pindexBlock)
+        return false;
+    // Fetched before taking cs: it may need cs_main, which callers can hold
+    std::shared_ptr<const ChainTipSnapshot> tip = GetChainTipSnapshot();
+    LOCK(cs);
+    return nMaxUsage > 0 && IsBuriedInChain(*tip, pindexBlock->GetBlockHash(), pindexBlock->nHeight, nMinDepth);
+}
+
+bool CBlockResponseCache::Get(const uint256& hash, BlockResponseFormat format, std::string& strOut)
+{
+    std::shared_ptr<const ChainTipSnapshot> tip = GetChainTipSnapshot();
+    LOCK(cs);
+    auto it = index.find(Key(hash, format));
+    if (it == index.end())
+        return false;
+    const Entry& entry = *it->second;
+    if (!IsBuriedInChain(*tip, entry.hashBlock, entry.nHeight, nMinDepth)) {
+        // Reorganized away, or the depth was raised
+        Erase(it);
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+
+    if (entry.nConfirmationsPos == std::string::npos && entry.nNextBlockHashPos == std::string::npos) {
+        strOut = entry.strData;
+        return true;
+    }
+    std::string strConfirmations, strNextBlockHash;
+    if (entry.nConfirmationsPos != std::string::npos)
+        strConfirmations = i64tostr(tip->nHeight - entry.nHeight + 1);
+    if (entry.nNextBlockHashPos != std::string::npos && tip->nHeight > entry.nHeight)
+        strNextBlockHash = NEXTBLOCKHASH_KEY + tip->pindex->GetAncestor(entry.nHeight + 1)->GetBlockHash().GetHex() + "\"";
+
+    // The confirmations come first, so splice from the front
+    strOut.clear();
+    strOut.reserve(entry.strData.size() + strConfirmations.size() + strNextBlockHash.size());
+    size_t nPos = 0;
+    if (entry.nConfirmationsPos != std::string::npos) {
+        strOut.append(entry.strData, 0, entry.nConfirmationsPos);
+        strOut += strConfirmations;
+        nPos = entry.nConfirmationsPos;
+    }
+    if (entry.nNextBlockHashPos != std::string::npos) {
+        strOut.append(entry.strData, nPos, entry.nNextBlockHashPos - nPos);
+        strOut += strNextBlockHash;
+        nPos = entry.nNextBlockHashPos;
+    }
+    strOut.append(entry.strData, nPos, std::string::npos);
+    return true;
+}
+
+void CBlockResponseCache::Put(const uint256& hash, BlockResponseFormat format, const CBlockIndex* pindexBlock, const std::string& strData)
+{
+    if (!pindexBlock)
+        return;
+    std::shared_ptr<const ChainTipSnapshot> tip = GetChainTipSnapshot();
+    LOCK(cs);
+    if (nMaxUsage == 0 || !IsBuriedInChain(*tip, pindexBlock->GetBlockHash(), pindexBlock->nHeight, nMinDepth))
+        return;
+
+    Entry entry;
+    entry.key = Key(hash, format);
+    entry.hashBlock = pindexBlock->GetBlockHash();
+    entry.nHeight = pindexBlock->nHeight;
+    entry.nConfirmationsPos = std::string::npos;
+    entry.nNextBlockHashPos = std::string::npos;
+    size_t nPos = HasConfirmations(format) ? strData.find(CONFIRMATIONS_KEY) : std::string::npos;
+    // The next block hash is the last field, after any transaction details.
+    // Quotes inside JSON strings are escaped, so the key cannot occur there.
+    size_t nNextPos = HasNextBlockHash(format) ? strData.rfind(NEXTBLOCKHASH_KEY) : std::string::npos;
+    if (HasNextBlockHash(format) && nNextPos == std::string::npos && tip->nHeight == pindexBlock->nHeight) {
+        // The block is the tip, so its successor is still to come
+        return;
+    }
+    size_t nEnd = std::string::npos, nNextEnd = std::string::npos;
+    if (nPos != std::string::npos) {
+        nPos += CONFIRMATIONS_KEY.size();
+        nEnd = strData.find_first_not_of("-0123456789", nPos);
+        if (nEnd == std::string::npos)
+            return;
+    }
+    if (nNextPos != std::string::npos) {
+        nNextEnd = strData.find('"', nNextPos + NEXTBLOCKHASH_KEY.size());
+        if (nNextEnd == std::string::npos || (nPos != std::string::npos && nNextPos < nEnd))
+            return;
+        nNextEnd++;
+    }
+
+    // Cut out the confirmations count and the next block hash, they are
+    // filled in on lookup
+    size_t nCut = 0;
+    if (nPos != std::string::npos)
+        nCut += nEnd - nPos;
+    if (nNextPos != std::string::npos)
+        nCut += nNextEnd - nNextPos;
+    entry.strData.reserve(strData.size() - nCut);
+    size_t nCopied = 0;
+    if (nPos != std::string::npos) {
+        entry.strData.append(strData, 0, nPos);
+        entry.nConfirmationsPos = nPos;
+        nCopied = nEnd;
+    }
+    if (nNextPos != std::string::npos) {
+        entry.strData.append(strData, nCopied, nNextPos - nCopied);
+        entry.nNextBlockHashPos = entry.strData.size();
+        nCopied = nNextEnd;
+    }
+    entry.strData.append(strData, nCopied, std::string::npos);
+
+    size_t nEntryUsage = EntryUsage(entry);
+    if (nEntryUsage > nMaxUsage)
+        return;
+
+    auto it = index.find(entry.key);
+    if (it != index.end())
+        Erase(it);
+    lru.push_front(std::move(entry));
+    index.emplace(lru.front().key, lru.begin());
+    nUsage += nEntryUsage;
+    while (nUsage > nMaxUsage)
+        Erase(index.find(lru.back().key));
+}
+
+void CBlockResponseCache::Clear()
+{
+    LOCK(cs);
+    lru.clear();
+    index.clear();
+    nUsage = 0;
+}
+
+size_t CBlockResponseCache::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return nUsage;
+}
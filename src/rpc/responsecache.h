@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The Datacoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_RESPONSECACHE_H
+#define BITCOIN_RPC_RESPONSECACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <string>
+
+class CBlockIndex;
+
+/** Default memory for the block response cache, in MiB */
+static const unsigned int DEFAULT_BLOCK_RESPONSE_CACHE_SIZE = 32;
+/** Default number of confirmations before a block's responses are cached */
+static const int DEFAULT_BLOCK_RESPONSE_CACHE_DEPTH = 6;
+/** getblock with transaction details is streamed rather than built in memory
+ *  for the cache when the serialized block is larger than this */
+static const unsigned int MAX_BLOCK_RESPONSE_CACHE_TXDETAILS_SIZE = 256 * 1024;
+
+/** Encodings of a block or transaction that can be cached */
+enum class BlockResponseFormat : uint8_t {
+    BLOCK_BINARY,
+    BLOCK_HEX,
+    BLOCK_JSON,             //!< getblock verbosity 1, REST notxdetails
+    BLOCK_JSON_TXDETAILS,   //!< getblock verbosity 2, REST block
+    TX_BINARY,
+    TX_HEX,
+    TX_JSON,                //!< getrawtransaction verbose
+    TX_JSON_REST,           //!< REST tx, without confirmations
+};
+
+/**
+ * Size-bounded LRU cache of encoded responses for blocks (and the
+ * transactions in them) buried deep in the active chain, keyed by block or
+ * transaction hash and format.
+ *
+ * Such responses only change through their "confirmations" and
+ * "nextblockhash" fields, which are cut out when storing and filled in from
+ * the current tip on lookup. An
+ * entry is dropped once its block is no longer an ancestor of the tip at
+ * the recorded height, so a reorg deeper than the cache depth invalidates it.
+ * The tip is taken from the RPC chain tip snapshot, so lookups do not need
+ * cs_main.
+ */
+class CBlockResponseCache
+{
+private:
+    typedef std::pair<uint256, BlockResponseFormat> Key;
+
+    struct Entry {
+        Key key;
+        uint256 hashBlock;
+        int nHeight;
+        std::string strData;
+        //! Where the confirmations count is spliced in, or npos
+        size_t nConfirmationsPos;
+        //! Where the next block hash is spliced in, or npos
+        size_t nNextBlockHashPos;
+    };
+
+    mutable CCriticalSection cs;
+    std::list<Entry> lru; //!< most recently used first
+    std::map<Key, std::list<Entry>::iterator> index;
+    size_t nUsage;
+    size_t nMaxUsage;
+    int nMinDepth;
+
+    static size_t EntryUsage(const Entry& entry);
+    void Erase(std::map<Key, std::list<Entry>::iterator>::iterator it);
+
+public:
+    CBlockResponseCache();
+
+    /** Set the memory limit in bytes (0 disables the cache) and the minimum depth */
+    void SetLimits(size_t nMaxUsageIn, int nMinDepthIn);
+
+    /** Whether responses for pindexBlock, or transactions in it, would be cached */
+    bool IsCacheable(const CBlockIndex* pindexBlock) const;
+
+    /** Look up a response; fails if missing or its block is no longer deep in the active chain */
+    bool Get(const uint256& hash, BlockResponseFormat format, std::string& strOut);
+
+    /** Store a response for hash, which is pindexBlock or a transaction in it */
+    void Put(const uint256& hash, BlockResponseFormat format, const CBlockIndex* pindexBlock, const std::string& strData);
+
+    void Clear();
+    size_t DynamicMemoryUsage() const;
+};
+
+extern CBlockResponseCache g_block_response_cache;
+
+#endif // BITCOIN_RPC_RESPONSECACHE_H
@@ -14,12 +14,14 @@
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
 
 class CRPCCommand;
+class JSONStreamWriter;
 
 namespace RPCServer
 {
@@ -45,8 +47,16 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
-
-    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
+    /** Set when the transport can stream the result. Handlers with large
+     *  results may then write the result to it instead of returning it;
+     *  the returned value is ignored once anything has been written. */
+    JSONStreamWriter* stream;
+    /** Raw payload posted to a binary endpoint (see /senddata), for
+     *  handlers that would otherwise take it base64 encoded. Mutable so
+     *  the handler can move it out instead of copying a large payload. */
+    mutable std::vector<unsigned char> binaryData;
+
+    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false), stream(nullptr) {}
     void parse(const UniValue& valRequest);
 };
 
@@ -5,11 +5,16 @@
 
 #include <script/sigcache.h>
 
+#include <clientversion.h>
+#include <hash.h>
 #include <memusage.h>
+#include <policy/policy.h>
 #include <pubkey.h>
 #include <random.h>
+#include <streams.h>
 #include <uint256.h>
 #include <util.h>
+#include <utiltime.h>
 
 #include <cuckoocache.h>
 #include <boost/thread.hpp>
@@ -25,6 +30,7 @@ class CSignatureCache
 private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
+    int64_t nNonceTime;
     typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
     boost::shared_mutex cs_sigcache;
@@ -33,6 +39,7 @@ public:
     CSignatureCache()
     {
         GetRandBytes(nonce.begin(), 32);
+        nNonceTime = GetTime();
     }
 
     void
@@ -57,6 +64,24 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    void GetSnapshot(CacheSnapshot& snapshot)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        snapshot.nonce = nonce;
+        snapshot.nNonceTime = nNonceTime;
+        setValid.get_live(snapshot.entries);
+    }
+
+    //! Adopt the snapshot's nonce, which its entries were computed with
+    void LoadSnapshot(const CacheSnapshot& snapshot)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = snapshot.nonce;
+        nNonceTime = snapshot.nNonceTime;
+        for (const uint256& entry : snapshot.entries)
+            setValid.insert(entry);
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -80,6 +105,85 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+bool WriteCacheSnapshot(const fs::path& path, const CacheSnapshot& snapshot)
+{
+    fs::path pathTmp = path;
+    pathTmp += ".new";
+    try {
+        CAutoFile fileout(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        hasher << snapshot;
+        fileout << snapshot;
+        fileout << hasher.GetHash();
+        FileCommit(fileout.Get());
+        fileout.fclose();
+    } catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    if (!RenameOver(pathTmp, path))
+        return error("%s: Rename-into-place failed", __func__);
+    return true;
+}
+
+bool ReadCacheSnapshot(const fs::path& path, CacheSnapshot& snapshot, unsigned int nScriptFlags)
+{
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+    try {
+        CHashVerifier<CAutoFile> verifier(&filein);
+        verifier >> snapshot;
+        uint256 hashTmp;
+        filein >> hashTmp;
+        if (hashTmp != verifier.GetHash())
+            return error("%s: Checksum mismatch, data corrupted", __func__);
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    if (snapshot.nClientVersion != CLIENT_VERSION || snapshot.nScriptFlags != nScriptFlags) {
+        LogPrintf("%s: Discarding %s, saved by client version %d with script flags %08x\n", __func__, path.string(), snapshot.nClientVersion, snapshot.nScriptFlags);
+        return false;
+    }
+    int64_t nAge = GetTime() - snapshot.nNonceTime;
+    if (nAge < 0 || nAge > MAX_SIG_CACHE_NONCE_AGE) {
+        LogPrintf("%s: Discarding %s, its nonce is due for renewal\n", __func__, path.string());
+        return false;
+    }
+    return true;
+}
+
+bool DumpSignatureCache()
+{
+    CacheSnapshot snapshot;
+    snapshot.nClientVersion = CLIENT_VERSION;
+    snapshot.nScriptFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    signatureCache.GetSnapshot(snapshot);
+    if (!WriteCacheSnapshot(GetDataDir() / "sigcache.dat", snapshot))
+        return false;
+    LogPrintf("Dumped %u signature cache entries\n", snapshot.entries.size());
+    return true;
+}
+
+bool LoadSignatureCache()
+{
+    fs::path path = GetDataDir() / "sigcache.dat";
+    CacheSnapshot snapshot;
+    bool fLoaded = ReadCacheSnapshot(path, snapshot, STANDARD_SCRIPT_VERIFY_FLAGS);
+    // Never reuse a saved cache twice: it is rewritten on a clean shutdown
+    try {
+        fs::remove(path);
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("%s: Unable to remove saved signature cache: %s\n", __func__, e.what());
+    }
+    if (!fLoaded)
+        return false;
+    signatureCache.LoadSnapshot(snapshot);
+    LogPrintf("Loaded %u signature cache entries from disk\n", snapshot.entries.size());
+    return true;
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
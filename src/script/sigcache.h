@@ -6,7 +6,10 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include <fs.h>
 #include <script/interpreter.h>
+#include <serialize.h>
+#include <uint256.h>
 
 #include <vector>
 
@@ -16,6 +19,10 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIG_CACHE = true;
+/** Saved caches whose nonce is older than this are discarded, so the nonce still gets renewed */
+static const int64_t MAX_SIG_CACHE_NONCE_AGE = 14 * 24 * 60 * 60;
 
 class CPubKey;
 
@@ -51,6 +58,42 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
 };
 
+/** On-disk form of a nonced validation cache: the client version and script
+ *  flags it was saved under, the nonce the entries were computed with, when
+ *  that nonce was generated, and the live entries. */
+struct CacheSnapshot
+{
+    int nClientVersion;
+    unsigned int nScriptFlags;
+    uint256 nonce;
+    int64_t nNonceTime;
+    std::vector<uint256> entries;
+
+    CacheSnapshot() : nClientVersion(0), nScriptFlags(0), nNonceTime(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nClientVersion);
+        READWRITE(nScriptFlags);
+        READWRITE(nonce);
+        READWRITE(nNonceTime);
+        READWRITE(entries);
+    }
+};
+
+/** Write a cache snapshot (with checksum) to path in the data directory */
+bool WriteCacheSnapshot(const fs::path& path, const CacheSnapshot& snapshot);
+/** Read a cache snapshot back. Fails on a bad checksum, an expired nonce, or a
+ *  snapshot saved by another client version or under other script flags. */
+bool ReadCacheSnapshot(const fs::path& path, CacheSnapshot& snapshot, unsigned int nScriptFlags);
+
 void InitSignatureCache();
+/** Save the signature cache to sigcache.dat */
+bool DumpSignatureCache();
+/** Restore the signature cache from sigcache.dat. Must be called after
+ *  InitSignatureCache() and before any signature is checked. */
+bool LoadSignatureCache();
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -138,6 +138,39 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for reading from a buffer owned by someone else. Unlike CDataStream,
+ *  reading does not consume the data.
+ */
+class CBufferReader
+{
+public:
+    CBufferReader(int nTypeIn, int nVersionIn, const char* pbeginIn, const char* pendIn) : nType(nTypeIn), nVersion(nVersionIn), pcur(pbeginIn), pend(pendIn) {}
+
+    template<typename T>
+    CBufferReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CBufferReader::read(): end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+    }
+    size_t size() const { return pend - pcur; }
+    bool empty() const { return pcur == pend; }
+    int GetVersion() const { return nVersion; }
+    int GetType() const { return nType; }
+private:
+    const int nType;
+    const int nVersion;
+    const char* pcur;
+    const char* pend;
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -4,10 +4,13 @@
 
 // Unit tests for denial-of-service detection/prevention code
 
+#include <blockencodings.h>
 #include <chainparams.h>
+#include <hash.h>
 #include <keystore.h>
 #include <net.h>
 #include <net_processing.h>
+#include <netmessagemaker.h>
 #include <pow.h>
 #include <script/sign.h>
 #include <serialize.h>
@@ -30,6 +33,9 @@ struct COrphanTx {
     int64_t nTimeExpire;
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions;
+extern double SmoothBlockDownloadStat(double current, double sample);
+extern int CalculateMaxBlocksInFlight(double dBlockBytesPerSecond, double dBlockAverageSize, int64_t nBlockLatency);
+extern bool IsBlockRequestOverdue(double dBlockBytesPerSecond, double dBlockAverageSize, int64_t nBlockLatency, int64_t nWaitingSince, int64_t nNow);
 
 CService ip(uint32_t i)
 {
@@ -40,6 +46,25 @@ CService ip(uint32_t i)
 
 static NodeId id = 0;
 
+// Queue a message on a mocked peer as if it had been received from the socket
+static void ReceiveTestMessage(CNode& node, const CSerializedNetMsg& msg)
+{
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ss(SER_NETWORK, INIT_PROTO_VERSION);
+    ss << hdr;
+    ss.write((const char*)msg.data.data(), msg.data.size());
+
+    CNetMessage netmsg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    int nHeader = netmsg.readHeader(ss.data(), ss.size());
+    netmsg.readData(ss.data() + nHeader, ss.size() - nHeader);
+    BOOST_REQUIRE(netmsg.complete());
+    LOCK(node.cs_vProcessMsg);
+    node.nProcessQueueSize += netmsg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+    node.vProcessMsg.push_back(netmsg);
+}
+
 void UpdateLastBlockAnnounceTime(NodeId node, int64_t time_in_seconds);
 
 BOOST_FIXTURE_TEST_SUITE(DoS_tests, TestingSetup)
@@ -382,4 +407,415 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+/** Whether a message with this command is queued to be sent to a mocked peer */
+static bool HasSentCommand(CNode& node, const std::string& strCommand)
+{
+    LOCK(node.cs_vSend);
+    for (const auto& buf : node.vSendMsg) {
+        if (buf->size() == CMessageHeader::HEADER_SIZE && memcmp(buf->data(), Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) == 0 &&
+                strCommand == (const char*)buf->data() + CMessageHeader::MESSAGE_START_SIZE)
+            return true;
+    }
+    return false;
+}
+
+static bool IsAskedFor(const CNode& node, const uint256& hash)
+{
+    for (const auto& entry : node.mapAskFor) {
+        if (entry.second.hash == hash)
+            return true;
+    }
+    return false;
+}
+
+BOOST_FIXTURE_TEST_CASE(headers_support_detection, TestChain100Setup)
+{
+    std::atomic<bool> interruptDummy(false);
+    CAddress addr(ip(0xa0b0c200), NODE_NONE);
+    CNode node(id++, ServiceFlags(NODE_NETWORK|NODE_WITNESS), 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ true);
+    node.SetSendVersion(PROTOCOL_VERSION);
+    node.SetRecvVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&node);
+    node.nVersion = PROTOCOL_VERSION;
+    node.fSuccessfullyConnected = true;
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    SetMockTime(GetTime());
+
+    // Until we know whether its headers are usable, an announced block is only fetched through getheaders
+    uint256 hash1 = GetRandHash();
+    ReceiveTestMessage(node, msgMaker.Make(NetMsgType::INV, std::vector<CInv>{CInv(MSG_BLOCK, hash1)}));
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    BOOST_CHECK(HasSentCommand(node, NetMsgType::GETHEADERS));
+    BOOST_CHECK(!IsAskedFor(node, hash1));
+
+    // No answer within the 30 second timeout: treated as legacy, and the pending block is requested directly
+    SetMockTime(GetTime() + 31);
+    {
+        LOCK(node.cs_sendProcessing);
+        peerLogic->SendMessages(&node, interruptDummy);
+    }
+    BOOST_CHECK(HasSentCommand(node, NetMsgType::GETDATA));
+
+    // Later announcements from a legacy peer are requested directly as well
+    uint256 hash2 = GetRandHash();
+    ReceiveTestMessage(node, msgMaker.Make(NetMsgType::INV, std::vector<CInv>{CInv(MSG_BLOCK, hash2)}));
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    BOOST_CHECK(IsAskedFor(node, hash2));
+
+    // A full header (with a prime chain multiplier) upgrades it to headers-first fetching
+    std::vector<CBlock> vHeaders(1);
+    vHeaders[0].hashPrevBlock = GetRandHash();
+    vHeaders[0].bnPrimeChainMultiplier = 1;
+    ReceiveTestMessage(node, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    uint256 hash3 = GetRandHash();
+    ReceiveTestMessage(node, msgMaker.Make(NetMsgType::INV, std::vector<CInv>{CInv(MSG_BLOCK, hash3)}));
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    BOOST_CHECK(!IsAskedFor(node, hash3));
+
+    // And headers without one make it legacy again
+    vHeaders[0].bnPrimeChainMultiplier = 0;
+    ReceiveTestMessage(node, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    uint256 hash4 = GetRandHash();
+    ReceiveTestMessage(node, msgMaker.Make(NetMsgType::INV, std::vector<CInv>{CInv(MSG_BLOCK, hash4)}));
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    BOOST_CHECK(IsAskedFor(node, hash4));
+    BOOST_CHECK(!node.fDisconnect);
+
+    SetMockTime(0);
+    bool dummy;
+    peerLogic->FinalizeNode(node.GetId(), dummy);
+}
+
+/** Have a fresh mocked peer request inv and return the command and payload buffer of our reply */
+static std::pair<std::string, std::shared_ptr<const std::vector<unsigned char>>> ServeGetData(PeerLogicValidation& peerLogic, const CInv& inv, bool fWantsCmpctWitness)
+{
+    std::atomic<bool> interruptDummy(false);
+    CAddress addr(ip(0xa0b0c100 + id), NODE_NONE);
+    CNode node(id++, ServiceFlags(NODE_NETWORK|NODE_WITNESS), 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ true);
+    node.SetSendVersion(PROTOCOL_VERSION);
+    node.SetRecvVersion(PROTOCOL_VERSION);
+    peerLogic.InitializeNode(&node);
+    node.nVersion = PROTOCOL_VERSION;
+    node.fSuccessfullyConnected = true;
+
+    if (fWantsCmpctWitness) {
+        ReceiveTestMessage(node, CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::SENDCMPCT, false, (uint64_t)2));
+        peerLogic.ProcessMessages(&node, interruptDummy);
+    }
+    node.vRecvGetData.push_back(inv);
+    peerLogic.ProcessMessages(&node, interruptDummy);
+
+    std::pair<std::string, std::shared_ptr<const std::vector<unsigned char>>> reply;
+    {
+        LOCK(node.cs_vSend);
+        BOOST_REQUIRE(node.vSendMsg.size() >= 2);
+        const std::vector<unsigned char>& header = **(node.vSendMsg.end() - 2);
+        reply.first = std::string((const char*)header.data() + CMessageHeader::MESSAGE_START_SIZE);
+        reply.second = node.vSendMsg.back();
+    }
+    bool dummy;
+    peerLogic.FinalizeNode(node.GetId(), dummy);
+    return reply;
+}
+
+BOOST_FIXTURE_TEST_CASE(block_serve_cache, TestChain100Setup)
+{
+    const CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    BOOST_REQUIRE(ReadBlockFromDisk(*pblock, tip, Params().GetConsensus()));
+    // Pins the compact block announcement payload, as when the block arrived
+    peerLogic->NewPoWValidBlock(tip, pblock);
+
+    BlockServeCacheStats before, after;
+    GetBlockServeCacheStats(before);
+
+    // A second request for the same block shares the buffer serialized for the first
+    auto reply1 = ServeGetData(*peerLogic, CInv(MSG_WITNESS_BLOCK, tip->GetBlockHash()), false);
+    auto reply2 = ServeGetData(*peerLogic, CInv(MSG_WITNESS_BLOCK, tip->GetBlockHash()), false);
+    BOOST_CHECK_EQUAL(reply1.first, NetMsgType::BLOCK);
+    BOOST_CHECK(reply1.second == reply2.second);
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << *pblock;
+    BOOST_CHECK(*reply1.second == std::vector<unsigned char>(ssBlock.begin(), ssBlock.end()));
+    GetBlockServeCacheStats(after);
+    BOOST_CHECK_EQUAL(after.nMisses, before.nMisses + 1);
+    BOOST_CHECK_EQUAL(after.nHits, before.nHits + 1);
+
+    // Blocks without witness data are cached under their own serialization flags
+    auto reply3 = ServeGetData(*peerLogic, CInv(MSG_BLOCK, tip->GetBlockHash()), false);
+    BOOST_CHECK(reply3.second != reply1.second);
+    CDataStream ssBlockNoWitness(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ssBlockNoWitness << *pblock;
+    BOOST_CHECK(*reply3.second == std::vector<unsigned char>(ssBlockNoWitness.begin(), ssBlockNoWitness.end()));
+
+    // Witness compact block peers hit the payload pinned at announcement time
+    GetBlockServeCacheStats(before);
+    auto reply4 = ServeGetData(*peerLogic, CInv(MSG_CMPCT_BLOCK, tip->GetBlockHash()), true);
+    BOOST_CHECK_EQUAL(reply4.first, NetMsgType::CMPCTBLOCK);
+    GetBlockServeCacheStats(after);
+    BOOST_CHECK_EQUAL(after.nHits, before.nHits + 1);
+    BOOST_CHECK_EQUAL(after.nMisses, before.nMisses);
+}
+
+BOOST_FIXTURE_TEST_CASE(message_decode_jobs, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<CMutableTransaction> spends(3);
+    for (int i = 0; i < 3; i++) {
+        spends[i].nVersion = 1;
+        spends[i].vin.resize(1);
+        spends[i].vin[0].prevout.hash = coinbaseTxns[i].GetHash();
+        spends[i].vin[0].prevout.n = 0;
+        spends[i].vout.resize(1);
+        spends[i].vout[0].nValue = 11*CENT;
+        spends[i].vout[0].scriptPubKey = scriptPubKey;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, spends[i], 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spends[i].vin[0].scriptSig << vchSig;
+    }
+
+    // Decoding reads the transaction without consuming the job's data
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << spends[0];
+    CNetMessageDecodeJob job(NetMsgType::TX, CDataStream(ssTx));
+    peerLogic->DecodeMessage(job);
+    BOOST_CHECK(job.fDone);
+    BOOST_REQUIRE(job.ptx);
+    BOOST_CHECK(job.ptx->GetHash() == spends[0].GetHash());
+    BOOST_CHECK_EQUAL(job.vRecv.size(), ssTx.size());
+
+    // Truncated data is left in place for the message handler to reject
+    CNetMessageDecodeJob jobShort(NetMsgType::TX, CDataStream(ssTx.begin(), ssTx.end() - 1, SER_NETWORK, PROTOCOL_VERSION));
+    peerLogic->DecodeMessage(jobShort);
+    BOOST_CHECK(jobShort.fDone);
+    BOOST_CHECK(!jobShort.ptx);
+    BOOST_CHECK_EQUAL(jobShort.vRecv.size(), ssTx.size() - 1);
+
+    std::atomic<bool> interruptDummy(false);
+    CAddress addr(ip(0xa0b0c300), NODE_NONE);
+    CNode node(id++, ServiceFlags(NODE_NETWORK|NODE_WITNESS), 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ true);
+    node.SetSendVersion(PROTOCOL_VERSION);
+    node.SetRecvVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&node);
+    node.nVersion = PROTOCOL_VERSION;
+    node.fSuccessfullyConnected = true;
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    // Hand each message's data to a decode job, as the socket thread does
+    auto receiveForDecode = [&](const CMutableTransaction& tx) {
+        ReceiveTestMessage(node, msgMaker.Make(NetMsgType::TX, tx));
+        LOCK(node.cs_vProcessMsg);
+        CNetMessage& msg = node.vProcessMsg.back();
+        msg.SetVersion(node.GetRecvVersion());
+        msg.decodeJob = std::make_shared<CNetMessageDecodeJob>(msg.hdr.pchCommand, std::move(msg.vRecv));
+        msg.vRecv.clear();
+        return msg.decodeJob;
+    };
+
+    // A decoded transaction is used as is: the handler does not read the data again
+    std::shared_ptr<CNetMessageDecodeJob> job1 = receiveForDecode(spends[1]);
+    peerLogic->DecodeMessage(*job1);
+    job1->vRecv.clear();
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    BOOST_CHECK(mempool.exists(spends[1].GetHash()));
+    BOOST_CHECK(job1->vRecv.empty());
+
+    // A message claimed before the decode thread got to it is read by the handler instead
+    std::shared_ptr<CNetMessageDecodeJob> job2 = receiveForDecode(spends[2]);
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    BOOST_CHECK(mempool.exists(spends[2].GetHash()));
+    peerLogic->DecodeMessage(*job2);
+    BOOST_CHECK(!job2->ptx);
+
+    // The data moved to the jobs stayed counted until the messages were processed
+    {
+        LOCK(node.cs_vProcessMsg);
+        BOOST_CHECK(node.vProcessMsg.empty());
+        BOOST_CHECK_EQUAL(node.nProcessQueueSize, 0U);
+    }
+    BOOST_CHECK(!node.fDisconnect);
+
+    bool dummy;
+    peerLogic->FinalizeNode(node.GetId(), dummy);
+}
+
+BOOST_AUTO_TEST_CASE(message_process_stats)
+{
+    std::atomic<bool> interruptDummy(false);
+    CAddress addr(ip(0xa0b0c500), NODE_NONE);
+    CNode node(id++, ServiceFlags(NODE_NETWORK|NODE_WITNESS), 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ true);
+    node.SetSendVersion(PROTOCOL_VERSION);
+    node.SetRecvVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&node);
+    node.nVersion = PROTOCOL_VERSION;
+    node.fSuccessfullyConnected = true;
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    NetStats before, after;
+    GetNetStats(before);
+
+    // A well-formed inv, and one whose stated item count runs past the end of the message
+    uint256 hash = GetRandHash();
+    ReceiveTestMessage(node, msgMaker.Make(NetMsgType::INV, std::vector<CInv>{CInv(MSG_BLOCK, hash)}));
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    ReceiveTestMessage(node, msgMaker.Make(NetMsgType::INV, std::vector<unsigned char>{2}));
+    peerLogic->ProcessMessages(&node, interruptDummy);
+    // And a command we don't know
+    ReceiveTestMessage(node, msgMaker.Make("notacommand", std::vector<unsigned char>{}));
+    peerLogic->ProcessMessages(&node, interruptDummy);
+
+    // All three are timed, including the one that threw
+    GetNetStats(after);
+    BOOST_CHECK_EQUAL(after.mapMsgProcess[NetMsgType::INV].nCount, before.mapMsgProcess[NetMsgType::INV].nCount + 2);
+    BOOST_CHECK_EQUAL(after.mapMsgProcess["*other*"].nCount, before.mapMsgProcess["*other*"].nCount + 1);
+    BOOST_CHECK(!after.mapMsgProcess.count("notacommand"));
+    uint64_t nBucketed = 0;
+    for (uint64_t nBucket : after.mapMsgProcess[NetMsgType::INV].vBuckets)
+        nBucketed += nBucket;
+    BOOST_CHECK_EQUAL(nBucketed, after.mapMsgProcess[NetMsgType::INV].nCount);
+
+    // The announced block starts a timeline
+    BOOST_REQUIRE(!after.vBlockTimeline.empty());
+    const BlockTimeline& timeline = after.vBlockTimeline.back();
+    BOOST_CHECK(timeline.hash == hash);
+    BOOST_CHECK(timeline.nFirstInv != 0);
+    BOOST_CHECK_EQUAL(timeline.nBlockReceived, 0);
+
+    bool dummy;
+    peerLogic->FinalizeNode(node.GetId(), dummy);
+}
+
+/** The transactions announced to a mocked peer, in order */
+static std::vector<CInv> GetSentInvs(CNode& node)
+{
+    std::vector<CInv> vInv;
+    LOCK(node.cs_vSend);
+    for (size_t i = 0; i + 1 < node.vSendMsg.size(); i += 2) {
+        const std::vector<unsigned char>& header = *node.vSendMsg[i];
+        if (std::string((const char*)header.data() + CMessageHeader::MESSAGE_START_SIZE) != NetMsgType::INV)
+            continue;
+        std::vector<CInv> vMsgInv;
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss.write((const char*)node.vSendMsg[i + 1]->data(), node.vSendMsg[i + 1]->size());
+        ss >> vMsgInv;
+        vInv.insert(vInv.end(), vMsgInv.begin(), vMsgInv.end());
+    }
+    return vInv;
+}
+
+BOOST_AUTO_TEST_CASE(large_tx_trickle)
+{
+    std::atomic<bool> interruptDummy(false);
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+
+    // Small transactions, large ones that fit the byte budget many times over, and huge ones that don't
+    std::set<uint256> setSmall, setLarge, setHuge;
+    for (int i = 0; i < 50; i++) {
+        LOCK(mempool.cs);
+        tx.nLockTime = i;
+        tx.data.clear();
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(1000 + i).FromTx(tx));
+        setSmall.insert(tx.GetHash());
+        tx.data.assign(DATA_PAYLOAD_DEFER_SIZE, 1);
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(1000 + i).FromTx(tx));
+        setLarge.insert(tx.GetHash());
+        tx.data.assign(INVENTORY_LARGE_TX_BURST / 10, 2);
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(1000 + i).FromTx(tx));
+        setHuge.insert(tx.GetHash());
+    }
+
+    auto trickle = [&](const std::set<uint256>& setTxToSend, std::vector<CInv>& vInv, int64_t& nBudget) {
+        CAddress addr(ip(0xa0b0c400 + id), NODE_NONE);
+        CNode node(id++, ServiceFlags(NODE_NETWORK|NODE_WITNESS), 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ true);
+        node.SetSendVersion(PROTOCOL_VERSION);
+        node.SetRecvVersion(PROTOCOL_VERSION);
+        peerLogic->InitializeNode(&node);
+        node.nVersion = PROTOCOL_VERSION;
+        node.fSuccessfullyConnected = true;
+        {
+            LOCK(node.cs_filter);
+            node.fRelayTxes = true;
+        }
+        {
+            LOCK(node.cs_inventory);
+            node.setInventoryTxToSend = setTxToSend;
+        }
+        {
+            LOCK(node.cs_sendProcessing);
+            peerLogic->SendMessages(&node, interruptDummy);
+        }
+        vInv = GetSentInvs(node);
+        CNodeStateStats stats;
+        BOOST_REQUIRE(GetNodeStateStats(node.GetId(), stats));
+        nBudget = stats.nLargeTxBudget;
+        bool dummy;
+        peerLogic->FinalizeNode(node.GetId(), dummy);
+    };
+    auto count = [](const std::vector<CInv>& vInv, const std::set<uint256>& setTx) {
+        return std::count_if(vInv.begin(), vInv.end(), [&setTx](const CInv& inv) { return setTx.count(inv.hash) != 0; });
+    };
+
+    // Large transactions get their own INVENTORY_BROADCAST_MAX slots next to the small ones
+    std::set<uint256> setTxToSend(setSmall);
+    setTxToSend.insert(setLarge.begin(), setLarge.end());
+    std::vector<CInv> vInv;
+    int64_t nBudget;
+    trickle(setTxToSend, vInv, nBudget);
+    BOOST_CHECK_EQUAL(vInv.size(), 2 * INVENTORY_BROADCAST_MAX);
+    BOOST_CHECK_EQUAL(count(vInv, setSmall), INVENTORY_BROADCAST_MAX);
+    BOOST_CHECK_EQUAL(count(vInv, setLarge), INVENTORY_BROADCAST_MAX);
+    BOOST_CHECK(nBudget > 0);
+
+    // Huge ones run out of byte budget first, without holding back the small ones
+    setTxToSend = setSmall;
+    setTxToSend.insert(setHuge.begin(), setHuge.end());
+    trickle(setTxToSend, vInv, nBudget);
+    BOOST_CHECK_EQUAL(count(vInv, setSmall), INVENTORY_BROADCAST_MAX);
+    BOOST_CHECK(count(vInv, setHuge) >= 9 && count(vInv, setHuge) <= 10);
+    BOOST_CHECK(nBudget < INVENTORY_LARGE_TX_BURST / 10);
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(block_download_limits)
+{
+    // The first sample is taken as is, later ones move the average by 1/8 of the difference
+    BOOST_CHECK_EQUAL(SmoothBlockDownloadStat(0, 800), 800);
+    BOOST_CHECK_EQUAL(SmoothBlockDownloadStat(800, 1600), 900);
+    BOOST_CHECK_EQUAL(SmoothBlockDownloadStat(900, 100), 800);
+
+    // Unmeasured peers get the default
+    BOOST_CHECK_EQUAL(CalculateMaxBlocksInFlight(0, 0, 0), DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(CalculateMaxBlocksInFlight(100000, 0, 0), DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // 10 blocks/s with a 1s round trip covers the latency plus the queue time
+    BOOST_CHECK_EQUAL(CalculateMaxBlocksInFlight(1000000, 100000, 1000000), 10 * (1 + BLOCK_DOWNLOAD_TARGET_QUEUE_TIME));
+    // Clamped on both ends
+    BOOST_CHECK_EQUAL(CalculateMaxBlocksInFlight(1, 1000000, 0), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(CalculateMaxBlocksInFlight(1e12, 1000, 1000000), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // Nothing is overdue before the minimum time, whatever the measurements
+    int64_t nMin = BLOCK_DOWNLOAD_REREQUEST_MIN_TIME * 1000000;
+    BOOST_CHECK(!IsBlockRequestOverdue(0, 0, 0, 0, nMin));
+    BOOST_CHECK(IsBlockRequestOverdue(0, 0, 0, 0, nMin + 1));
+    BOOST_CHECK(!IsBlockRequestOverdue(1e9, 1000, 0, 0, nMin));
+    // A slow peer gets twice its expected latency plus transfer time: 2 * (1s + 10s)
+    BOOST_CHECK(!IsBlockRequestOverdue(100000, 1000000, 1000000, 1000, 1000 + 22000000));
+    BOOST_CHECK(IsBlockRequestOverdue(100000, 1000000, 1000000, 1000, 1000 + 22000001));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
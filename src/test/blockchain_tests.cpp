@@ -123,4 +123,119 @@ BOOST_AUTO_TEST_CASE(get_difficulty_for_block_index_overrides_tip)
     RejectDifficultyMismatch(difficulty, 5913134931067755359633408.0);
 }
 
+BOOST_FIXTURE_TEST_CASE(chain_tip_snapshot, TestChain100Setup)
+{
+    CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+
+    // Nothing published yet: the current tip is used
+    std::shared_ptr<const ChainTipSnapshot> snapshot = GetChainTipSnapshot();
+    BOOST_CHECK_EQUAL(snapshot->nHeight, tip->nHeight);
+    BOOST_CHECK(snapshot->hash == tip->GetBlockHash());
+    BOOST_CHECK(snapshot->pindex == tip);
+
+    // A published snapshot is served until the next tip notification
+    RPCNotifyBlockChange(false, tip);
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    BOOST_CHECK_EQUAL(GetChainTipSnapshot()->nHeight, tip->nHeight);
+    BOOST_CHECK(snapshot->hash == GetChainTipSnapshot()->hash);
+
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    RPCNotifyBlockChange(false, tip);
+    BOOST_CHECK_EQUAL(GetChainTipSnapshot()->nHeight, tip->nHeight);
+    BOOST_CHECK(GetChainTipSnapshot()->hash == tip->GetBlockHash());
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), tip->nHeight);
+
+    // A late notification for an older tip still publishes the current one
+    RPCNotifyBlockChange(false, tip->pprev);
+    BOOST_CHECK(GetChainTipSnapshot()->hash == tip->GetBlockHash());
+
+    // Resetting falls back to the current tip again
+    RPCNotifyBlockChange(false, nullptr);
+    BOOST_CHECK(GetChainTipSnapshot()->hash == tip->GetBlockHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(block_response_cache, TestChain100Setup)
+{
+    CBlockResponseCache cache;
+    cache.SetLimits(1 << 20, 6);
+    CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    RPCNotifyBlockChange(false, tip);
+    const CBlockIndex* deep = tip->GetAncestor(tip->nHeight - 10);
+    const CBlockIndex* shallow = tip->GetAncestor(tip->nHeight - 4);
+    std::string str;
+
+    // Only blocks with enough confirmations are cached
+    BOOST_CHECK(cache.IsCacheable(deep));
+    BOOST_CHECK(!cache.IsCacheable(shallow));
+    cache.Put(deep->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, deep, "00ff");
+    cache.Put(shallow->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, shallow, "00ff");
+    BOOST_CHECK(cache.Get(deep->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, str));
+    BOOST_CHECK_EQUAL(str, "00ff");
+    BOOST_CHECK(!cache.Get(shallow->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, str));
+    BOOST_CHECK(!cache.Get(deep->GetBlockHash(), BlockResponseFormat::BLOCK_BINARY, str));
+
+    // Confirmations follow the tip
+    cache.Put(deep->GetBlockHash(), BlockResponseFormat::BLOCK_JSON, deep, "{\"hash\":\"x\",\"confirmations\":11,\"size\":1}");
+    BOOST_CHECK(cache.Get(deep->GetBlockHash(), BlockResponseFormat::BLOCK_JSON, str));
+    BOOST_CHECK_EQUAL(str, "{\"hash\":\"x\",\"confirmations\":11,\"size\":1}");
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    RPCNotifyBlockChange(false, tip);
+    BOOST_CHECK(cache.Get(deep->GetBlockHash(), BlockResponseFormat::BLOCK_JSON, str));
+    BOOST_CHECK_EQUAL(str, "{\"hash\":\"x\",\"confirmations\":12,\"size\":1}");
+
+    // The next block hash is taken from the tip's chain, not from when the entry was stored
+    const std::string strNext = tip->GetAncestor(deep->nHeight + 1)->GetBlockHash().GetHex();
+    cache.Put(deep->GetBlockHash(), BlockResponseFormat::BLOCK_JSON_TXDETAILS, deep,
+              "{\"confirmations\":12,\"tx\":[{\"hex\":\"00\"}],\"nextblockhash\":\"" + std::string(64, 'f') + "\"}");
+    BOOST_CHECK(cache.Get(deep->GetBlockHash(), BlockResponseFormat::BLOCK_JSON_TXDETAILS, str));
+    BOOST_CHECK_EQUAL(str, "{\"confirmations\":12,\"tx\":[{\"hex\":\"00\"}],\"nextblockhash\":\"" + strNext + "\"}");
+
+    // The tip has no successor yet, so its JSON is not cached
+    cache.SetLimits(1 << 20, 1);
+    cache.Put(tip->GetBlockHash(), BlockResponseFormat::BLOCK_JSON, tip, "{\"confirmations\":1}");
+    BOOST_CHECK(!cache.Get(tip->GetBlockHash(), BlockResponseFormat::BLOCK_JSON, str));
+    cache.Put(tip->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, tip, "00ff");
+    BOOST_CHECK(cache.Get(tip->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, str));
+    cache.SetLimits(1 << 20, 6);
+
+    // Raising the depth drops entries that are no longer deep enough
+    cache.SetLimits(1 << 20, 20);
+    BOOST_CHECK(!cache.Get(deep->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, str));
+
+    // Least recently used entries are evicted first
+    cache.Clear();
+    cache.SetLimits(3000, 6);
+    const CBlockIndex* deeper = tip->GetAncestor(tip->nHeight - 20);
+    cache.Put(deep->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, deep, std::string(1500, 'a'));
+    cache.Put(deeper->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, deeper, std::string(1500, 'b'));
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= 3000);
+    BOOST_CHECK(!cache.Get(deep->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, str));
+    BOOST_CHECK(cache.Get(deeper->GetBlockHash(), BlockResponseFormat::BLOCK_HEX, str));
+    BOOST_CHECK_EQUAL(str, std::string(1500, 'b'));
+
+    // Disabled
+    cache.SetLimits(0, 6);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(!cache.IsCacheable(deeper));
+
+    RPCNotifyBlockChange(false, nullptr);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -90,6 +90,7 @@ BOOST_AUTO_TEST_CASE(SimpleRoundTripTest)
         BOOST_CHECK( partialBlock.IsTxAvailable(0));
         BOOST_CHECK(!partialBlock.IsTxAvailable(1));
         BOOST_CHECK( partialBlock.IsTxAvailable(2));
+        BOOST_CHECK_EQUAL(partialBlock.MissingTxCount(), 1U);
 
         BOOST_CHECK_EQUAL(pool.mapTx.find(block.vtx[2]->GetHash())->GetSharedTx().use_count(), SHARED_TX_OFFSET + 1);
 
@@ -354,4 +355,70 @@ BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BOOST_CHECK_EQUAL(req1.indexes[3], req2.indexes[3]);
 }
 
+BOOST_AUTO_TEST_CASE(PayloadDeferredTransactionSerializationTest) {
+    CMutableTransaction small;
+    small.vin.resize(1);
+    small.vin[0].scriptSig.resize(10);
+    small.vout.resize(1);
+    small.vout[0].nValue = 42;
+    small.data.resize(DATA_PAYLOAD_DEFER_SIZE - 1, 0x11);
+    CMutableTransaction large(small);
+    large.data.assign(DATA_PAYLOAD_DEFER_SIZE, 0x22);
+
+    // Payloads below the threshold stay in the transaction
+    PayloadDeferredTransaction dtx1(MakeTransactionRef(small));
+    BOOST_CHECK(!dtx1.IsDeferred());
+    BOOST_CHECK_EQUAL(dtx1.tx->data.size(), small.data.size());
+
+    PayloadDeferredTransaction dtx2(MakeTransactionRef(large));
+    BOOST_CHECK(dtx2.IsDeferred());
+    BOOST_CHECK(dtx2.tx->data.empty());
+    BOOST_CHECK(dtx2.payloadHash == Hash(large.data.begin(), large.data.end()));
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << dtx1 << dtx2;
+
+    PayloadDeferredTransaction dtx3, dtx4;
+    stream >> dtx3 >> dtx4;
+    BOOST_CHECK(stream.empty());
+    BOOST_CHECK(!dtx3.IsDeferred());
+    BOOST_CHECK_EQUAL(dtx3.tx->GetHash().ToString(), small.GetHash().ToString());
+    BOOST_CHECK(dtx4.IsDeferred());
+    BOOST_CHECK(dtx4.payloadHash == dtx2.payloadHash);
+    BOOST_CHECK_EQUAL(dtx4.WithPayload(large.data)->GetHash().ToString(), large.GetHash().ToString());
+}
+
+BOOST_AUTO_TEST_CASE(BlockTransactionsDeferredSerializationTest) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    BlockTransactions resp;
+    resp.blockhash = InsecureRand256();
+    resp.txn.push_back(MakeTransactionRef(tx));
+    tx.data.assign(DATA_PAYLOAD_DEFER_SIZE, 0x33);
+    resp.txn.push_back(MakeTransactionRef(tx));
+    tx.data.assign(DATA_PAYLOAD_DEFER_SIZE * 2, 0x44);
+    resp.txn.push_back(MakeTransactionRef(tx));
+
+    BlockTransactionsDeferred msg1(resp);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << msg1;
+    // The large payloads are left out of the message
+    BOOST_CHECK(stream.size() < DATA_PAYLOAD_DEFER_SIZE);
+
+    BlockTransactionsDeferred msg2;
+    stream >> msg2;
+    BOOST_CHECK_EQUAL(msg2.blockhash.ToString(), resp.blockhash.ToString());
+    BOOST_REQUIRE_EQUAL(msg2.txn.size(), resp.txn.size());
+    BOOST_CHECK(!msg2.txn[0].IsDeferred());
+    BOOST_CHECK_EQUAL(msg2.txn[0].tx->GetHash().ToString(), resp.txn[0]->GetHash().ToString());
+    for (size_t i = 1; i < resp.txn.size(); i++) {
+        BOOST_CHECK(msg2.txn[i].IsDeferred());
+        BOOST_CHECK_EQUAL(msg2.txn[i].WithPayload(resp.txn[i]->data)->GetHash().ToString(), resp.txn[i]->GetHash().ToString());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -209,6 +209,31 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Random)
     Correct_Queue_range(range);
 }
 
+/** Test that checks added to the master's deque are stolen by workers,
+ * without the master joining in through Wait().
+ */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Stealing)
+{
+    auto queue = std::unique_ptr<Correct_Queue>(new Correct_Queue {4});
+    boost::thread_group tg;
+    for (auto x = 0; x < nScriptCheckThreads; ++x) {
+       tg.create_thread([&]{queue->Thread();});
+    }
+    const size_t nChecks = 1000;
+    FakeCheckCheckCompletion::n_calls = 0;
+    {
+        CCheckQueueControl<FakeCheckCheckCompletion> control(queue.get());
+        std::vector<FakeCheckCheckCompletion> vChecks(nChecks);
+        control.Add(vChecks);
+        // Every slot, including the master's own, must drain by stealing
+        for (int i = 0; i < 10000 && FakeCheckCheckCompletion::n_calls != nChecks; i++)
+            MilliSleep(1);
+        BOOST_CHECK_EQUAL(FakeCheckCheckCompletion::n_calls, nChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
 
 /** Test that failing checks are caught */
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
@@ -2,10 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include <boost/test/unit_test.hpp>
+#include <clientversion.h>
 #include <cuckoocache.h>
 #include <script/sigcache.h>
 #include <test/test_bitcoin.h>
 #include <random.h>
+#include <utiltime.h>
+
+#include <algorithm>
 #include <thread>
 
 /** Test Suite for CuckooCache
@@ -377,4 +381,102 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that get_live returns exactly the inserted elements which have not
+ * been marked for erasure.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_get_live)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    // Far below the capacity, so nothing gets evicted
+    std::vector<uint256> inserted(1000);
+    for (uint256& v : inserted) {
+        insecure_GetRandHash(v);
+        cc.insert(v);
+    }
+    std::vector<uint256> live;
+    cc.get_live(live);
+    std::sort(live.begin(), live.end());
+    std::vector<uint256> expected = inserted;
+    std::sort(expected.begin(), expected.end());
+    BOOST_CHECK(live == expected);
+
+    // Erase every other element
+    expected.clear();
+    for (size_t i = 0; i < inserted.size(); ++i) {
+        if (i % 2)
+            BOOST_CHECK(cc.contains(inserted[i], true));
+        else
+            expected.push_back(inserted[i]);
+    }
+    live.clear();
+    cc.get_live(live);
+    std::sort(live.begin(), live.end());
+    std::sort(expected.begin(), expected.end());
+    BOOST_CHECK(live == expected);
+}
+
+/* Test that a cache snapshot survives a write/read round-trip, and that
+ * corrupted files and expired nonces are rejected.
+ */
+BOOST_FIXTURE_TEST_CASE(cuckoocache_snapshot_roundtrip, TestingSetup)
+{
+    local_rand_ctx = FastRandomContext(true);
+    const fs::path path = GetDataDir() / "snapshot_test.dat";
+    CacheSnapshot snapshot;
+    snapshot.nClientVersion = CLIENT_VERSION;
+    snapshot.nScriptFlags = SCRIPT_VERIFY_P2SH;
+    insecure_GetRandHash(snapshot.nonce);
+    snapshot.nNonceTime = GetTime() - 60;
+    snapshot.entries.resize(100);
+    for (uint256& v : snapshot.entries)
+        insecure_GetRandHash(v);
+
+    BOOST_REQUIRE(WriteCacheSnapshot(path, snapshot));
+    CacheSnapshot loaded;
+    BOOST_REQUIRE(ReadCacheSnapshot(path, loaded, SCRIPT_VERIFY_P2SH));
+    BOOST_CHECK(loaded.nonce == snapshot.nonce);
+    BOOST_CHECK_EQUAL(loaded.nNonceTime, snapshot.nNonceTime);
+    BOOST_CHECK(loaded.entries == snapshot.entries);
+
+    // Flip a byte in the middle of the file: the checksum must catch it
+    {
+        FILE* file = fsbridge::fopen(path, "r+b");
+        BOOST_REQUIRE(file);
+        BOOST_REQUIRE_EQUAL(fseek(file, 100, SEEK_SET), 0);
+        int c = fgetc(file);
+        BOOST_REQUIRE_EQUAL(fseek(file, 100, SEEK_SET), 0);
+        fputc(c ^ 0xff, file);
+        fclose(file);
+    }
+    CacheSnapshot corrupted;
+    BOOST_CHECK(!ReadCacheSnapshot(path, corrupted, SCRIPT_VERIFY_P2SH));
+
+    // A snapshot from another client version, or for other script flags, is not reused
+    BOOST_REQUIRE(WriteCacheSnapshot(path, snapshot));
+    CacheSnapshot otherFlags;
+    BOOST_CHECK(!ReadCacheSnapshot(path, otherFlags, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS));
+    snapshot.nClientVersion = CLIENT_VERSION - 1;
+    BOOST_REQUIRE(WriteCacheSnapshot(path, snapshot));
+    CacheSnapshot otherVersion;
+    BOOST_CHECK(!ReadCacheSnapshot(path, otherVersion, SCRIPT_VERIFY_P2SH));
+    snapshot.nClientVersion = CLIENT_VERSION;
+
+    // A nonce that is due for renewal, or from the future, is not reused
+    snapshot.nNonceTime = GetTime() - MAX_SIG_CACHE_NONCE_AGE - 1;
+    BOOST_REQUIRE(WriteCacheSnapshot(path, snapshot));
+    CacheSnapshot expired;
+    BOOST_CHECK(!ReadCacheSnapshot(path, expired, SCRIPT_VERIFY_P2SH));
+    snapshot.nNonceTime = GetTime() + 3600;
+    BOOST_REQUIRE(WriteCacheSnapshot(path, snapshot));
+    CacheSnapshot future;
+    BOOST_CHECK(!ReadCacheSnapshot(path, future, SCRIPT_VERIFY_P2SH));
+
+    // A missing file simply fails
+    fs::remove(path);
+    CacheSnapshot missing;
+    BOOST_CHECK(!ReadCacheSnapshot(path, missing, SCRIPT_VERIFY_P2SH));
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -571,4 +571,61 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolDataLimitTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    // A low-fee payment and two data transactions paying far more
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    tx2.data.assign(10000, 0x42);
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(100000LL).FromTx(tx2));
+
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].scriptSig = CScript() << OP_3;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_3 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    tx3.data.assign(10000, 0x43);
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(200000LL).FromTx(tx3));
+
+    size_t nDataUsage = memusage::DynamicUsage(CTransaction(tx2).data);
+    BOOST_CHECK_EQUAL(pool.GetDataUsage(), 2 * nDataUsage);
+
+    pool.TrimToSize(pool.DynamicMemoryUsage(), nullptr, pool.GetDataUsage()); // should do nothing
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+    BOOST_CHECK(pool.exists(tx3.GetHash()));
+
+    // The data budget evicts the lower-feerate data transaction, never the payment
+    pool.TrimToSize(pool.DynamicMemoryUsage(), nullptr, nDataUsage);
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(!pool.exists(tx2.GetHash()));
+    BOOST_CHECK(pool.exists(tx3.GetHash()));
+    BOOST_CHECK_EQUAL(pool.GetDataUsage(), nDataUsage);
+
+    // ... and bumps only the data min fee
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+    BOOST_CHECK(pool.GetDataMinFee(1).GetFeePerK() > 0);
+
+    pool.TrimToSize(pool.DynamicMemoryUsage(), nullptr, 0);
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(!pool.exists(tx3.GetHash()));
+    BOOST_CHECK_EQUAL(pool.GetDataUsage(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
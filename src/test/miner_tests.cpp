@@ -3402,6 +3402,59 @@ void TestPackageSelection(const CChainParams& chainparams, CScript scriptPubKey,
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
 }
 
+// Test that a template builds on the transactions selected for the last one, and
+// that fee delta changes make it start over. Reuses the chain of CreateNewBlock_validity.
+void TestSelectionReuse(const CChainParams& chainparams, CScript scriptPubKey, std::vector<CTransactionRef>& txFirst, std::vector<CAmount>& vBLOCKSUBSIDY)
+{
+    TestMemPoolEntryHelper entry;
+    mempool.clear();
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = txFirst[0]->GetHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = vBLOCKSUBSIDY[0] - 5000000;
+    uint256 hashLowFeeTx = tx.GetHash();
+    mempool.addUnchecked(hashLowFeeTx, entry.Fee(5000000).Time(GetTime()).SpendsCoinbase(true).FromTx(tx));
+    std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 2);
+
+    // The block had room for everything, so a better transaction arriving later is
+    // added after the ones already selected
+    tx.vin[0].prevout.hash = txFirst[1]->GetHash();
+    tx.vout[0].nValue = vBLOCKSUBSIDY[1] - 50000000;
+    uint256 hashHighFeeTx = tx.GetHash();
+    mempool.addUnchecked(hashHighFeeTx, entry.Fee(50000000).Time(GetTime()).SpendsCoinbase(true).FromTx(tx));
+    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashLowFeeTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashHighFeeTx);
+
+    // Nothing changed: the same selection
+    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashLowFeeTx);
+
+    // Any fee delta starts over, in fee rate order
+    mempool.PrioritiseTransaction(hashHighFeeTx, 1);
+    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashHighFeeTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashLowFeeTx);
+
+    // And drops transactions whose modified fee no longer pays for their place
+    mempool.PrioritiseTransaction(hashLowFeeTx, -5000000);
+    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashHighFeeTx);
+
+    mempool.ClearPrioritisation(hashLowFeeTx);
+    mempool.ClearPrioritisation(hashHighFeeTx);
+    mempool.clear();
+}
+
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
 BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 {
@@ -3737,6 +3790,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     mempool.clear();
 
     TestPackageSelection(chainparams, scriptPubKey, txFirst, vBLOCKSUBSIDY);
+    TestSelectionReuse(chainparams, scriptPubKey, txFirst, vBLOCKSUBSIDY);
 
     fCheckpointsEnabled = true;
 }
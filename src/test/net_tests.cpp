@@ -15,6 +15,16 @@
 
 #include <memory>
 
+#ifndef WIN32
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Tests this internal-to-net.cpp method:
+extern bool WaitForSocketEvents(const std::set<SOCKET> &recv_select_set, const std::set<SOCKET> &send_select_set, const std::set<SOCKET> &error_select_set,
+                                std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set, int nTimeout);
+
 class CAddrManSerializationMock : public CAddrMan
 {
 public:
@@ -187,4 +197,53 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(socket_events)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    std::set<SOCKET> sockets = {(SOCKET)fds[0]};
+    std::set<SOCKET> recv_set, send_set, error_set;
+
+    // Writable but nothing to read yet
+    BOOST_CHECK(WaitForSocketEvents(sockets, sockets, sockets, recv_set, send_set, error_set, 0));
+    BOOST_CHECK(recv_set.empty());
+    BOOST_CHECK(send_set.count(fds[0]));
+    BOOST_CHECK(error_set.empty());
+
+    // Readable once the other end has written
+    BOOST_CHECK(write(fds[1], "x", 1) == 1);
+    recv_set.clear(); send_set.clear();
+    BOOST_CHECK(WaitForSocketEvents(sockets, {}, {}, recv_set, send_set, error_set, 1000));
+    BOOST_CHECK(recv_set.count(fds[0]));
+    BOOST_CHECK(send_set.empty());
+
+    // Nothing requested, nothing reported
+    recv_set.clear();
+    BOOST_CHECK(WaitForSocketEvents({}, {}, {}, recv_set, send_set, error_set, 0));
+    BOOST_CHECK(recv_set.empty() && send_set.empty() && error_set.empty());
+
+#ifdef USE_POLL
+    // poll() has no FD_SETSIZE cap, so descriptors above it are usable if the limit allows them
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur > (rlim_t)FD_SETSIZE + 1) {
+        SOCKET high = dup2(fds[0], FD_SETSIZE + 1);
+        BOOST_REQUIRE(high == FD_SETSIZE + 1);
+        BOOST_CHECK(IsSelectableSocket(high));
+        recv_set.clear();
+        BOOST_CHECK(WaitForSocketEvents({high}, {}, {}, recv_set, send_set, error_set, 1000));
+        BOOST_CHECK(recv_set.count(high));
+        close(high);
+    }
+#endif
+
+    // A closed peer is reported as readable (recv returns 0), or as a hangup
+    close(fds[1]);
+    recv_set.clear(); error_set.clear();
+    BOOST_CHECK(WaitForSocketEvents(sockets, {}, sockets, recv_set, send_set, error_set, 1000));
+    BOOST_CHECK(recv_set.count(fds[0]) || error_set.count(fds[0]));
+    close(fds[0]);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
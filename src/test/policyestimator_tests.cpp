@@ -179,4 +179,51 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(TxClassEstimates)
+{
+    CBlockPolicyEstimator feeEst;
+    CTxMemPool mpool(&feeEst);
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction payTx;
+    payTx.vin.resize(1);
+    payTx.vout.resize(1);
+    payTx.vout[0].nValue = 0LL;
+    CMutableTransaction dataTx = payTx;
+    dataTx.data.assign(FEE_ESTIMATE_LARGE_DATA_SIZE + 1000, 'D');
+
+    // Payments and large data uploads both confirm in the next block, but the
+    // uploads pay five times the feerate
+    CFeeRate payRate(10000);
+    CFeeRate dataRate(50000);
+    BOOST_CHECK(FeeEstimateTxClassForTx(payTx) == FeeEstimateTxClass::PAYMENT);
+    BOOST_CHECK(FeeEstimateTxClassForTx(dataTx) == FeeEstimateTxClass::LARGE_DATA);
+
+    std::vector<CTransactionRef> block;
+    for (int blocknum = 0; blocknum < 50; blocknum++) {
+        for (int k = 0; k < 4; k++) {
+            payTx.vin[0].prevout.n = 100 * blocknum + k;
+            dataTx.vin[0].prevout.n = 100 * blocknum + 50 + k;
+            mpool.addUnchecked(payTx.GetHash(), entry.Fee(payRate.GetFee(GetVirtualTransactionSize(payTx))).Time(GetTime()).Height(blocknum).FromTx(payTx));
+            mpool.addUnchecked(dataTx.GetHash(), entry.Fee(dataRate.GetFee(GetVirtualTransactionSize(dataTx))).Time(GetTime()).Height(blocknum).FromTx(dataTx));
+            block.push_back(mpool.get(payTx.GetHash()));
+            block.push_back(mpool.get(dataTx.GetHash()));
+        }
+        mpool.removeForBlock(block, blocknum + 1);
+        block.clear();
+    }
+
+    CFeeRate allEst = feeEst.estimateSmartFee(2, nullptr, false);
+    CFeeRate payEst = feeEst.estimateSmartFee(2, nullptr, false, FeeEstimateTxClass::PAYMENT);
+    CFeeRate dataEst = feeEst.estimateSmartFee(2, nullptr, false, FeeEstimateTxClass::LARGE_DATA);
+    BOOST_CHECK(payEst.GetFeePerK() > payRate.GetFeePerK() * 9 / 10);
+    BOOST_CHECK(payEst.GetFeePerK() < payRate.GetFeePerK() * 11 / 10);
+    BOOST_CHECK(dataEst.GetFeePerK() > dataRate.GetFeePerK() * 9 / 10);
+    BOOST_CHECK(dataEst.GetFeePerK() < dataRate.GetFeePerK() * 11 / 10);
+    // Over all transactions the cheaper payments are what gets estimated
+    BOOST_CHECK(allEst.GetFeePerK() < dataEst.GetFeePerK());
+    // Nothing seen for this class
+    BOOST_CHECK(feeEst.estimateSmartFee(2, nullptr, false, FeeEstimateTxClass::SMALL_DATA) == CFeeRate(0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
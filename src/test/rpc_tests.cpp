@@ -4,10 +4,16 @@
 
 #include <rpc/server.h>
 #include <rpc/client.h>
+#include <rpc/jsonstream.h>
 
 #include <base58.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
 #include <core_io.h>
+#include <net.h>
 #include <netbase.h>
+#include <script/sign.h>
+#include <validation.h>
 
 #include <test/test_bitcoin.h>
 
@@ -82,6 +88,16 @@ BOOST_AUTO_TEST_CASE(rpc_rawparams)
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction null"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction DEADBEEF"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC(std::string("sendrawtransaction ")+rawtx+" extra"), std::runtime_error);
+
+    // sendrawtransactions rejects batches over its limit before decoding them
+    std::string batch = "[\"" + rawtx + "\"";
+    for (int i = 1; i < 1001; i++)
+        batch += ",\"" + rawtx + "\"";
+    batch += "]";
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions null"), std::runtime_error);
+    BOOST_CHECK_EXCEPTION(CallRPC("sendrawtransactions " + batch), std::runtime_error, [](const std::runtime_error& e) {
+        return std::string(e.what()).find("Too many transactions") != std::string::npos;
+    });
 }
 
 BOOST_AUTO_TEST_CASE(rpc_togglenetwork)
@@ -345,4 +361,168 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_json_stream)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("a", 1));
+    obj.push_back(Pair("esc\"aped", "line\nbreak"));
+    UniValue arr(UniValue::VARR);
+    arr.push_back(UniValue(UniValue::VOBJ));
+    arr.push_back(UniValue(UniValue::VARR));
+    arr.push_back(NullUniValue);
+    arr.push_back(std::string(100, 'x'));
+    obj.push_back(Pair("arr", arr));
+
+    // Small chunks force flushes in the middle of containers
+    std::string out;
+    int nChunks = 0;
+    JSONStreamWriter stream([&](const std::string& chunk) { out += chunk; nChunks++; }, 16);
+    BOOST_CHECK(stream.empty());
+    stream.value(obj);
+    stream.flush();
+    BOOST_CHECK(!stream.empty());
+    BOOST_CHECK(stream.flushed());
+    BOOST_CHECK(nChunks > 1);
+    BOOST_CHECK_EQUAL(out, obj.write());
+
+    // Incremental writes match the equivalent tree
+    out.clear();
+    JSONStreamWriter stream2([&](const std::string& chunk) { out += chunk; });
+    stream2.beginArray();
+    stream2.value(1);
+    stream2.beginObject();
+    stream2.pushKV("k", arr);
+    stream2.key("o");
+    stream2.beginObject();
+    stream2.endObject();
+    stream2.endObject();
+    stream2.endArray();
+    BOOST_CHECK(!stream2.flushed());
+    stream2.flush();
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("k", arr));
+    inner.push_back(Pair("o", UniValue(UniValue::VOBJ)));
+    UniValue expected(UniValue::VARR);
+    expected.push_back(1);
+    expected.push_back(inner);
+    BOOST_CHECK_EQUAL(out, expected.write());
+}
+
+/** A transaction paying nValue from the given output of a coinbaseKey transaction back to coinbaseKey */
+static CMutableTransaction SpendToKey(const CKey& key, const uint256& hashPrev, uint32_t n, CAmount nValue)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+static void SetSegwitActive(bool fActive)
+{
+    LOCK(cs_main);
+    if (fActive)
+        UpdateVersionBitsParameters(Consensus::DEPLOYMENT_SEGWIT, Consensus::BIP9Deployment::ALWAYS_ACTIVE, Consensus::BIP9Deployment::NO_TIMEOUT);
+    else
+        UpdateVersionBitsParameters(Consensus::DEPLOYMENT_SEGWIT, 999999999999LL, 999999999999LL);
+    versionbitscache.Clear();
+}
+
+/**
+ * getblocktemplate encodes its transaction list once per template; make sure the
+ * cached list follows the template (a new mempool state, a prioritisetransaction)
+ * and is never served for the wrong side of segwit activation.
+ */
+BOOST_FIXTURE_TEST_CASE(rpc_getblocktemplate_transactions, TestChain100Setup)
+{
+    const std::string strRequest = "getblocktemplate {\"rules\":[\"segwit\"]}";
+    CAddress addr(CService(), NODE_NONE);
+    CNode dummyNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true);
+    CConnmanTest::AddNode(dummyNode);
+
+    // Mature a second coinbase so two independent transactions can be spent
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    SetSegwitActive(true);
+
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+    UniValue r = CallRPC(strRequest);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "transactions").size(), 0U);
+    int64_t nTemplateId = find_value(r.get_obj(), "templateid").get_int64();
+
+    auto toMempool = [](const CMutableTransaction& tx) {
+        LOCK(cs_main);
+        CValidationState state;
+        return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */,
+                                  nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */);
+    };
+    CMutableTransaction low = SpendToKey(coinbaseKey, coinbaseTxns[0].GetHash(), 0, coinbaseTxns[0].vout[0].nValue - 1 * COIN);
+    CMutableTransaction high = SpendToKey(coinbaseKey, coinbaseTxns[1].GetHash(), 0, coinbaseTxns[1].vout[0].nValue - 2 * COIN);
+    BOOST_REQUIRE(toMempool(low));
+    BOOST_REQUIRE(toMempool(high));
+
+    // Within the template's lifetime the cached (empty) list is kept
+    r = CallRPC(strRequest);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "templateid").get_int64(), nTemplateId);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "transactions").size(), 0U);
+
+    // A new template brings a new list
+    SetMockTime(nTime += 6);
+    r = CallRPC(strRequest);
+    BOOST_CHECK(find_value(r.get_obj(), "templateid").get_int64() != nTemplateId);
+    nTemplateId = find_value(r.get_obj(), "templateid").get_int64();
+    UniValue txs = find_value(r.get_obj(), "transactions");
+    BOOST_REQUIRE_EQUAL(txs.size(), 2U);
+    BOOST_CHECK_EQUAL(find_value(txs[0].get_obj(), "txid").get_str(), high.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(find_value(txs[1].get_obj(), "txid").get_str(), low.GetHash().GetHex());
+
+    // And so does a prioritisetransaction, once the template is rebuilt for it
+    CallRPC("prioritisetransaction " + low.GetHash().GetHex() + " 0 " + std::to_string(10 * COIN));
+    SetMockTime(nTime += 6);
+    r = CallRPC(strRequest);
+    BOOST_CHECK(find_value(r.get_obj(), "templateid").get_int64() != nTemplateId);
+    nTemplateId = find_value(r.get_obj(), "templateid").get_int64();
+    txs = find_value(r.get_obj(), "transactions");
+    BOOST_REQUIRE_EQUAL(txs.size(), 2U);
+    BOOST_CHECK_EQUAL(find_value(txs[0].get_obj(), "txid").get_str(), low.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(find_value(txs[1].get_obj(), "txid").get_str(), high.GetHash().GetHex());
+    const int64_t nSigOpsSegwit = find_value(txs[0].get_obj(), "sigops").get_int64();
+    BOOST_CHECK(nSigOpsSegwit > 0);
+
+    // The same template reports sigops in the units of each side of activation,
+    // switching back and forth without a new template in between
+    SetSegwitActive(false);
+    r = CallRPC(strRequest);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "templateid").get_int64(), nTemplateId);
+    txs = find_value(r.get_obj(), "transactions");
+    BOOST_REQUIRE_EQUAL(txs.size(), 2U);
+    BOOST_CHECK_EQUAL(find_value(txs[0].get_obj(), "sigops").get_int64(), nSigOpsSegwit / WITNESS_SCALE_FACTOR);
+
+    SetSegwitActive(true);
+    r = CallRPC(strRequest);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "templateid").get_int64(), nTemplateId);
+    txs = find_value(r.get_obj(), "transactions");
+    BOOST_REQUIRE_EQUAL(txs.size(), 2U);
+    BOOST_CHECK_EQUAL(find_value(txs[0].get_obj(), "sigops").get_int64(), nSigOpsSegwit);
+
+    // TestChain100Setup's deployment parameters, for the tests that follow
+    {
+        LOCK(cs_main);
+        UpdateVersionBitsParameters(Consensus::DEPLOYMENT_SEGWIT, 0, Consensus::BIP9Deployment::NO_TIMEOUT);
+        versionbitscache.Clear();
+    }
+    SetMockTime(0);
+    CConnmanTest::ClearNodes();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -68,6 +68,30 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_buffer_reader)
+{
+    std::vector<char> vch = {1, 2, 3, 4, 5, 6};
+    CBufferReader reader(SER_NETWORK, INIT_PROTO_VERSION, vch.data(), vch.data() + vch.size());
+    BOOST_CHECK_EQUAL(reader.size(), 6U);
+
+    unsigned char a(0);
+    uint32_t b(0);
+    reader >> a >> b;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(b, 0x05040302U);
+    BOOST_CHECK_EQUAL(reader.size(), 1U);
+    BOOST_CHECK(!reader.empty());
+
+    // Reading past the end throws and leaves the remaining data readable
+    BOOST_CHECK_THROW(reader >> b, std::ios_base::failure);
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 6);
+    BOOST_CHECK(reader.empty());
+
+    // The underlying buffer is never modified
+    BOOST_CHECK((vch == std::vector<char>{{1, 2, 3, 4, 5, 6}}));
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
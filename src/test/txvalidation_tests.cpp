@@ -8,7 +8,10 @@
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
+#include <script/sign.h>
+#include <streams.h>
 #include <test/test_bitcoin.h>
+#include <util.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -58,4 +61,158 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK_EQUAL(nDoS, 100);
 }
 
+/** A transaction paying nValue from the given output of a coinbaseKey transaction back to coinbaseKey */
+static CMutableTransaction SpendToKey(const CKey& key, const uint256& hashPrev, uint32_t n, CAmount nValue)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+/** Write a version 2 mempool.dat holding the given transactions with the given entry state */
+static void WriteMempoolFile(const uint256& hashTip, const std::vector<std::pair<CTransactionRef, CAmount>>& vEntries, int64_t nSigOpCost)
+{
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "mempool.dat", "wb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    file << (uint64_t)2 << hashTip << (uint64_t)vEntries.size();
+    for (const auto& entry : vEntries) {
+        file << entry.first << GetTime() << (int64_t)0;
+        file << entry.second << (unsigned int)0 << false << nSigOpCost;
+        file << (int)0 << (int64_t)0 << uint256();
+    }
+    file << std::map<uint256, CAmount>();
+}
+
+static CAmount GetMempoolFee(const uint256& hash)
+{
+    LOCK(mempool.cs);
+    auto it = mempool.mapTx.find(hash);
+    BOOST_REQUIRE(it != mempool.mapTx.end());
+    return it->GetFee();
+}
+
+/**
+ * Ensure that mempool.dat restores the entries it was dumped with, and that
+ * the entry state stored with them is checked rather than trusted.
+ */
+BOOST_FIXTURE_TEST_CASE(mempool_persist_restore, TestChain100Setup)
+{
+    auto spend = [this](const uint256& hashPrev, uint32_t n, CAmount nValue) {
+        return SpendToKey(coinbaseKey, hashPrev, n, nValue);
+    };
+    auto toMempool = [](const CMutableTransaction& tx) {
+        LOCK(cs_main);
+        CValidationState state;
+        return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */,
+                                  nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */);
+    };
+
+    const CAmount nFee = 1 * COIN;
+    CMutableTransaction parent = spend(coinbaseTxns[0].GetHash(), 0, coinbaseTxns[0].vout[0].nValue - nFee);
+    CMutableTransaction child = spend(parent.GetHash(), 0, parent.vout[0].nValue - nFee);
+    BOOST_REQUIRE(toMempool(parent));
+    BOOST_REQUIRE(toMempool(child));
+
+    // Round trip
+    BOOST_CHECK(DumpMempool());
+    mempool.clear();
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+    BOOST_CHECK_EQUAL(GetMempoolFee(parent.GetHash()), nFee);
+    BOOST_CHECK_EQUAL(GetMempoolFee(child.GetHash()), nFee);
+
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    // A stored fee or sigop count that doesn't match is not taken over: the
+    // transaction goes through AcceptToMemoryPool and gets its real fee
+    mempool.clear();
+    BOOST_REQUIRE(toMempool(parent));
+    WriteMempoolFile(hashTip, {{MakeTransactionRef(child), 100 * nFee}}, 0);
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK(mempool.exists(child.GetHash()));
+    BOOST_CHECK_EQUAL(GetMempoolFee(child.GetHash()), nFee);
+
+    // Entries spending an output the parent doesn't have, or with a bad signature,
+    // are not restored whatever the stored state says
+    mempool.clear();
+    BOOST_REQUIRE(toMempool(parent));
+    CMutableTransaction badIndex = spend(parent.GetHash(), 1, parent.vout[0].nValue - nFee);
+    CMutableTransaction badSig(child);
+    badSig.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1);
+    WriteMempoolFile(hashTip, {{MakeTransactionRef(badIndex), nFee}, {MakeTransactionRef(badSig), nFee}}, 4);
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 1U);
+    BOOST_CHECK(!mempool.exists(badIndex.GetHash()));
+    BOOST_CHECK(!mempool.exists(badSig.GetHash()));
+
+    // A truncated file is rejected
+    {
+        CAutoFile file(fsbridge::fopen(GetDataDir() / "mempool.dat", "wb"), SER_DISK, CLIENT_VERSION);
+        file << (uint64_t)2 << hashTip << (uint64_t)1;
+    }
+    mempool.clear();
+    BOOST_CHECK(!LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+}
+
+/**
+ * Ensure that a batch accepts its valid transactions, including chains, when
+ * one of them fails its script checks.
+ */
+BOOST_FIXTURE_TEST_CASE(mempool_accept_batch, TestChain100Setup)
+{
+    // Mature the coinbases spent below
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 2; i++)
+        CreateAndProcessBlock({}, scriptPubKey);
+
+    const CAmount nFee = 1 * COIN;
+    CMutableTransaction badSig = SpendToKey(coinbaseKey, coinbaseTxns[0].GetHash(), 0, coinbaseTxns[0].vout[0].nValue - nFee);
+    badSig.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1);
+    CMutableTransaction parent = SpendToKey(coinbaseKey, coinbaseTxns[1].GetHash(), 0, coinbaseTxns[1].vout[0].nValue - nFee);
+    CMutableTransaction child = SpendToKey(coinbaseKey, parent.GetHash(), 0, parent.vout[0].nValue - nFee);
+    CMutableTransaction other = SpendToKey(coinbaseKey, coinbaseTxns[2].GetHash(), 0, coinbaseTxns[2].vout[0].nValue - nFee);
+
+    // The failing transaction comes first, so its precheck fails before the others run
+    std::vector<CTransactionRef> vtx{MakeTransactionRef(badSig), MakeTransactionRef(parent), MakeTransactionRef(child), MakeTransactionRef(other)};
+    std::vector<CValidationState> vstate;
+    std::vector<bool> vMissingInputs;
+    BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, vtx, vstate, vMissingInputs, 0 /* nAbsurdFee */), 3U);
+    BOOST_REQUIRE_EQUAL(vstate.size(), vtx.size());
+    BOOST_CHECK(vstate[0].IsInvalid());
+    BOOST_CHECK(!vMissingInputs[0]);
+    for (size_t i = 1; i < vtx.size(); i++) {
+        BOOST_CHECK(vstate[i].IsValid());
+        BOOST_CHECK(mempool.exists(vtx[i]->GetHash()));
+    }
+    BOOST_CHECK(!mempool.exists(badSig.GetHash()));
+
+    // Transactions already in the pool, or repeated within the batch, are
+    // accepted as by sendrawtransaction
+    CMutableTransaction grandchild = SpendToKey(coinbaseKey, child.GetHash(), 0, child.vout[0].nValue - nFee);
+    vtx = {MakeTransactionRef(parent), MakeTransactionRef(grandchild), MakeTransactionRef(grandchild)};
+    BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, vtx, vstate, vMissingInputs, 0 /* nAbsurdFee */), 3U);
+    BOOST_REQUIRE_EQUAL(vstate.size(), vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++) {
+        BOOST_CHECK(vstate[i].IsValid());
+        BOOST_CHECK(!vMissingInputs[i]);
+    }
+    BOOST_CHECK(mempool.exists(grandchild.GetHash()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -26,6 +26,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
 {
     nTxWeight = GetTransactionWeight(*tx);
     nUsageSize = RecursiveDynamicUsage(tx);
+    nDataUsage = memusage::DynamicUsage(tx->data);
 
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
@@ -329,7 +330,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), nFeeDeltasUpdated(0), minerPolicyEstimator(estimator)
 {
     _clear(); //lock free clear
 
@@ -357,6 +358,12 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+unsigned int CTxMemPool::GetFeeDeltasUpdated() const
+{
+    LOCK(cs);
+    return nFeeDeltasUpdated;
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
     NotifyEntryAdded(entry.GetSharedTx());
@@ -382,6 +389,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // (When we update the entry for in-mempool parents, memory usage will be
     // further updated.)
     cachedInnerUsage += entry.DynamicMemoryUsage();
+    cachedDataUsage += entry.GetDataUsage();
 
     const CTransaction& tx = newit->GetTx();
     std::set<uint256> setParentTransactions;
@@ -434,6 +442,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
+    cachedDataUsage -= it->GetDataUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
     mapLinks.erase(it);
     mapTx.erase(it);
@@ -586,6 +595,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
+    lastRollingDataFeeUpdate = GetTime();
+    blockSinceLastRollingDataFeeBump = true;
 }
 
 void CTxMemPool::_clear()
@@ -595,9 +606,13 @@ void CTxMemPool::_clear()
     mapNextTx.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    cachedDataUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
+    lastRollingDataFeeUpdate = GetTime();
+    blockSinceLastRollingDataFeeBump = false;
+    rollingDataMinimumFeeRate = 0;
     ++nTransactionsUpdated;
 }
 
@@ -628,6 +643,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     uint64_t checkTotal = 0;
     uint64_t innerUsage = 0;
+    uint64_t dataUsage = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
     const int64_t spendheight = GetSpendHeight(mempoolDuplicate);
@@ -638,6 +654,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
+        dataUsage += it->GetDataUsage();
         const CTransaction& tx = it->GetTx();
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
         assert(linksiter != mapLinks.end());
@@ -736,6 +753,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+    assert(dataUsage == cachedDataUsage);
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb)
@@ -814,6 +832,20 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<CTxMemPoolEntry> CTxMemPool::entryAll() const
+{
+    LOCK(cs);
+    auto iters = GetSortedDepthAndScore();
+
+    std::vector<CTxMemPoolEntry> ret;
+    ret.reserve(mapTx.size());
+    for (auto it : iters) {
+        ret.push_back(*it);
+    }
+
+    return ret;
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -838,6 +870,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
         LOCK(cs);
         CAmount &delta = mapDeltas[hash];
         delta += nFeeDelta;
+        ++nFeeDeltasUpdated;
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(delta));
@@ -907,7 +940,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -980,28 +1013,38 @@ const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) cons
     return it->second.children;
 }
 
-CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const { //DATACOIN FEE allow free == false
-    LOCK(cs);
-    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
-        return CFeeRate(llround(rollingMinimumFeeRate));
+CFeeRate CTxMemPool::DecayRollingFee(double& rate, int64_t& lastUpdate, bool fBlockSinceBump, size_t usage, size_t limit) const {
+    AssertLockHeld(cs);
+    if (!fBlockSinceBump || rate == 0)
+        return CFeeRate(llround(rate));
 
     int64_t time = GetTime();
-    if (time > lastRollingFeeUpdate + 10) {
+    if (time > lastUpdate + 10) {
         double halflife = ROLLING_FEE_HALFLIFE;
-        if (DynamicMemoryUsage() < sizelimit / 4)
+        if (usage < limit / 4)
             halflife /= 4;
-        else if (DynamicMemoryUsage() < sizelimit / 2)
+        else if (usage < limit / 2)
             halflife /= 2;
 
-        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
-        lastRollingFeeUpdate = time;
+        rate = rate / pow(2.0, (time - lastUpdate) / halflife);
+        lastUpdate = time;
 
-        if (rollingMinimumFeeRate < (double)incrementalRelayFee.GetFeePerK() / 2) {
-            rollingMinimumFeeRate = 0;
+        if (rate < (double)incrementalRelayFee.GetFeePerK() / 2) {
+            rate = 0;
             return CFeeRate(0);
         }
     }
-    return std::max(CFeeRate(llround(rollingMinimumFeeRate)), incrementalRelayFee);
+    return std::max(CFeeRate(llround(rate)), incrementalRelayFee);
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const { //DATACOIN FEE allow free == false
+    LOCK(cs);
+    return DecayRollingFee(rollingMinimumFeeRate, lastRollingFeeUpdate, blockSinceLastRollingFeeBump, DynamicMemoryUsage(), sizelimit);
+}
+
+CFeeRate CTxMemPool::GetDataMinFee(size_t datasizelimit) const {
+    LOCK(cs);
+    return DecayRollingFee(rollingDataMinimumFeeRate, lastRollingDataFeeUpdate, blockSinceLastRollingDataFeeBump, cachedDataUsage, datasizelimit);
 }
 
 void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
@@ -1012,26 +1055,21 @@ void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     }
 }
 
-void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining) {
-    LOCK(cs);
-
-    unsigned nTxnRemoved = 0;
-    CFeeRate maxFeeRateRemoved(0);
-    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+void CTxMemPool::trackDataPackageRemoved(const CFeeRate& rate) {
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingDataMinimumFeeRate) {
+        rollingDataMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingDataFeeBump = false;
+    }
+}
 
-        // We set the new mempool min fee to the feerate of the removed set, plus the
-        // "minimum reasonable fee rate" (ie some value under which we consider txn
-        // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
-        // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
-        removed += incrementalRelayFee;
-        trackPackageRemoved(removed);
-        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining, size_t datasizelimit) {
+    LOCK(cs);
 
+    // Remove the package rooted at it, returning the number of transactions removed.
+    auto removePackage = [&](txiter it) {
         setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
-        nTxnRemoved += stage.size();
+        CalculateDescendants(it, stage);
 
         std::vector<CTransaction> txn;
         if (pvNoSpendsRemaining) {
@@ -1048,6 +1086,45 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
                 }
             }
         }
+        return (unsigned)stage.size();
+    };
+
+    //DATACOIN Enforce the data budget first. Only packages rooted at a data
+    // transaction are candidates here, and only the data min fee is bumped, so
+    // a flood of payloads cannot push payments out or price them out.
+    unsigned nDataTxnRemoved = 0;
+    CFeeRate maxDataFeeRateRemoved(0);
+    while (cachedDataUsage > datasizelimit) {
+        indexed_transaction_set::index<data_descendant_score>::type::iterator it = mapTx.get<data_descendant_score>().begin();
+        assert(it != mapTx.get<data_descendant_score>().end() && it->HasData());
+
+        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        removed += incrementalRelayFee;
+        trackDataPackageRemoved(removed);
+        maxDataFeeRateRemoved = std::max(maxDataFeeRateRemoved, removed);
+
+        nDataTxnRemoved += removePackage(mapTx.project<0>(it));
+    }
+
+    if (maxDataFeeRateRemoved > CFeeRate(0)) {
+        LogPrint(BCLog::MEMPOOL, "Removed %u data txn, rolling data minimum fee bumped to %s\n", nDataTxnRemoved, maxDataFeeRateRemoved.ToString());
+    }
+
+    unsigned nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+
+        // We set the new mempool min fee to the feerate of the removed set, plus the
+        // "minimum reasonable fee rate" (ie some value under which we consider txn
+        // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
+        // equal to txn which were removed with no block in between.
+        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        removed += incrementalRelayFee;
+        trackPackageRemoved(removed);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        nTxnRemoved += removePackage(mapTx.project<0>(it));
     }
 
     if (maxFeeRateRemoved > CFeeRate(0)) {
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <limits>
 #include <memory>
 #include <set>
 #include <map>
@@ -68,6 +69,7 @@ private:
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
     size_t nTxWeight;          //!< ... and avoid recomputing tx weight (also used for GetTxSize())
     size_t nUsageSize;         //!< ... and total memory usage
+    size_t nDataUsage;         //!< ... of which taken by the data payload (0 for payment transactions)
     int64_t nTime;             //!< Local time when entering the mempool
     unsigned int entryHeight;  //!< Chain height when entering the mempool
     bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
@@ -104,6 +106,8 @@ public:
     int64_t GetSigOpCost() const { return sigOpCost; }
     int64_t GetModifiedFee() const { return nFee + feeDelta; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
+    size_t GetDataUsage() const { return nDataUsage; }
+    bool HasData() const { return nDataUsage != 0; }
     const LockPoints& GetLockPoints() const { return lockPoints; }
 
     // Adjusts the descendant state.
@@ -310,8 +314,26 @@ public:
     }
 };
 
+/** \class CompareTxMemPoolEntryByDataDescendantScore
+ *
+ *  Eviction order for the data budget: transactions carrying a data payload
+ *  sort before payment transactions, and by descendant score within each class.
+ */
+class CompareTxMemPoolEntryByDataDescendantScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        if (a.HasData() != b.HasData()) {
+            return a.HasData();
+        }
+        return CompareTxMemPoolEntryByDescendantScore()(a, b);
+    }
+};
+
 // Multi_index tag names
 struct descendant_score {};
+struct data_descendant_score {};
 struct entry_time {};
 struct mining_score {};
 struct ancestor_score {};
@@ -440,16 +462,24 @@ class CTxMemPool
 private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
+    unsigned int nFeeDeltasUpdated; //!< Counts PrioritiseTransaction calls, for BlockAssembler to drop its last selection
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    uint64_t cachedDataUsage;  //!< sum of data payload usage of all the map elements (included in cachedInnerUsage)
 
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
+    mutable int64_t lastRollingDataFeeUpdate;
+    mutable bool blockSinceLastRollingDataFeeBump;
+    mutable double rollingDataMinimumFeeRate; //!< as rollingMinimumFeeRate, bumped only by data budget evictions
+
     void trackPackageRemoved(const CFeeRate& rate);
+    void trackDataPackageRemoved(const CFeeRate& rate);
+    CFeeRate DecayRollingFee(double& rate, int64_t& lastUpdate, bool fBlockSinceBump, size_t usage, size_t limit) const;
 
 public:
 
@@ -483,6 +513,12 @@ public:
                 boost::multi_index::tag<ancestor_score>,
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
+            >,
+            // data payload transactions first, then by fee rate (for data budget eviction)
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<data_descendant_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByDataDescendantScore
             >
         >
     > indexed_transaction_set;
@@ -557,6 +593,7 @@ public:
     bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    unsigned int GetFeeDeltasUpdated() const;
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
@@ -614,11 +651,20 @@ public:
       */
     CFeeRate GetMinFee(size_t sizelimit) const;
 
-    /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
+    /** The minimum fee for a transaction carrying a data payload. Raised only
+      *  when data transactions are evicted to honour the data budget, so a
+      *  payload flood prices out further payloads without touching GetMinFee.
+      */
+    CFeeRate GetDataMinFee(size_t datasizelimit) const;
+
+    /** Remove transactions from the mempool until its dynamic size is <= sizelimit
+      *  and the usage of data payloads is <= datasizelimit. The data budget is
+      *  enforced first and only evicts data transactions (and their descendants).
       *  pvNoSpendsRemaining, if set, will be populated with the list of outpoints
       *  which are not in mempool which no longer have any spends in this mempool.
       */
-    void TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining=nullptr);
+    void TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining=nullptr,
+                    size_t datasizelimit=std::numeric_limits<size_t>::max());
 
     /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
     int Expire(int64_t time);
@@ -647,9 +693,18 @@ public:
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Copies of all entries, parents before children */
+    std::vector<CTxMemPoolEntry> entryAll() const;
 
     size_t DynamicMemoryUsage() const;
 
+    /** Memory used by the data payloads of all transactions in the pool */
+    uint64_t GetDataUsage() const
+    {
+        LOCK(cs);
+        return cachedDataUsage;
+    }
+
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
 
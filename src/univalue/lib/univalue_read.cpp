@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <stdint.h>
 #include <string.h>
 #include <vector>
 #include <stdio.h>
@@ -15,6 +16,28 @@ static bool json_isdigit(int ch)
     return ((ch >= '0') && (ch <= '9'));
 }
 
+// true if any of the 8 bytes at p needs more than a plain copy inside a
+// string: '"', '\\', control characters or non-ASCII bytes
+static bool json_word_has_special(const char *p)
+{
+    static const uint64_t ones = 0x0101010101010101ULL;
+    static const uint64_t highs = 0x8080808080808080ULL;
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    uint64_t quote = w ^ (ones * '"');
+    uint64_t bslash = w ^ (ones * '\\');
+    return ((w | // non-ASCII
+             ((w - ones * 0x20) & ~w) | // control character
+             ((quote - ones) & ~quote) | // '"'
+             ((bslash - ones) & ~bslash)) // '\\'
+            & highs) != 0;
+}
+
+static bool json_is_plain_char(unsigned char ch)
+{
+    return ch >= 0x20 && ch < 0x80 && ch != '"' && ch != '\\';
+}
+
 // convert hexadecimal string to unsigned integer
 static const char *hatoui(const char *first, const char *last,
                           unsigned int& out)
@@ -114,8 +137,6 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '8':
     case '9': {
         // part 1: int
-        string numStr;
-
         const char *first = raw;
 
         const char *firstDigit = first;
@@ -124,49 +145,37 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
         if ((*firstDigit == '0') && json_isdigit(firstDigit[1]))
             return JTOK_ERR;
 
-        numStr += *raw;                       // copy first char
-        raw++;
+        raw++;                                // skip first char
 
         if ((*first == '-') && (raw < end) && (!json_isdigit(*raw)))
             return JTOK_ERR;
 
-        while (raw < end && json_isdigit(*raw)) {  // copy digits
-            numStr += *raw;
+        while (raw < end && json_isdigit(*raw))  // skip digits
             raw++;
-        }
 
         // part 2: frac
         if (raw < end && *raw == '.') {
-            numStr += *raw;                   // copy .
-            raw++;
+            raw++;                            // skip .
 
             if (raw >= end || !json_isdigit(*raw))
                 return JTOK_ERR;
-            while (raw < end && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while (raw < end && json_isdigit(*raw)) // skip digits
                 raw++;
-            }
         }
 
         // part 3: exp
         if (raw < end && (*raw == 'e' || *raw == 'E')) {
-            numStr += *raw;                   // copy E
-            raw++;
+            raw++;                            // skip E
 
-            if (raw < end && (*raw == '-' || *raw == '+')) { // copy +/-
-                numStr += *raw;
+            if (raw < end && (*raw == '-' || *raw == '+')) // skip +/-
                 raw++;
-            }
 
             if (raw >= end || !json_isdigit(*raw))
                 return JTOK_ERR;
-            while (raw < end && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while (raw < end && json_isdigit(*raw)) // skip digits
                 raw++;
-            }
         }
-
-        tokenVal = numStr;
+        tokenVal.assign(first, raw);
         consumed = (raw - rawStart);
         return JTOK_NUMBER;
         }
@@ -174,10 +183,20 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '"': {
         raw++;                                // skip "
 
-        string valStr;
-        JSONUTF8StringFilter writer(valStr);
+        JSONUTF8StringFilter writer(tokenVal);
 
         while (true) {
+            // copy runs of plain chars in bulk, scanning 8 bytes at a time
+            const char *run = raw;
+            while (end - run >= 8 && !json_word_has_special(run))
+                run += 8;
+            while (run < end && json_is_plain_char(*run))
+                run++;
+            if (run != raw) {
+                writer.append_ascii(raw, run);
+                raw = run;
+            }
+
             if (raw >= end || (unsigned char)*raw < 0x20)
                 return JTOK_ERR;
 
@@ -228,7 +247,6 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
 
         if (!writer.finalize())
             return JTOK_ERR;
-        tokenVal = valStr;
         consumed = (raw - rawStart);
         return JTOK_STRING;
         }
@@ -402,34 +420,25 @@ bool UniValue::read(const char *raw, size_t size)
             break;
             }
 
-        case JTOK_NUMBER: {
-            UniValue tmpVal(VNUM, tokenVal);
-            if (!stack.size()) {
-                *this = tmpVal;
-                break;
-            }
-
-            UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
-
-            setExpect(NOT_VALUE);
-            break;
-            }
-
+        case JTOK_NUMBER:
         case JTOK_STRING: {
-            if (expect(OBJ_NAME)) {
+            // Token text is swapped into place rather than copied, which
+            // matters for large hex strings
+            if (tok == JTOK_STRING && expect(OBJ_NAME)) {
                 UniValue *top = stack.back();
-                top->keys.push_back(tokenVal);
+                top->keys.push_back(string());
+                top->keys.back().swap(tokenVal);
                 clearExpect(OBJ_NAME);
                 setExpect(COLON);
             } else {
-                UniValue tmpVal(VSTR, tokenVal);
-                if (!stack.size()) {
-                    *this = tmpVal;
-                    break;
+                UniValue *dest = this;
+                if (stack.size()) {
+                    UniValue *top = stack.back();
+                    top->values.push_back(UniValue());
+                    dest = &top->values.back();
                 }
-                UniValue *top = stack.back();
-                top->values.push_back(tmpVal);
+                dest->typ = (tok == JTOK_STRING ? VSTR : VNUM);
+                dest->val.swap(tokenVal);
             }
 
             setExpect(NOT_VALUE);
@@ -45,6 +45,13 @@ public:
                 push_back_u(codepoint);
         }
     }
+    // Write a run of 7-bit ASCII chars, same as calling push_back on each
+    void append_ascii(const char *first, const char *last)
+    {
+        if (state) // Not a continuation, invalid
+            is_valid = false;
+        str.append(first, last);
+    }
     // Write codepoint directly, possibly collating surrogate pairs
     void push_back_u(unsigned int codepoint_)
     {
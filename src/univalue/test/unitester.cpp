@@ -157,6 +157,30 @@ void unescape_unicode_test()
     f_assert(val[0].get_str() == "\xf0\x9d\x85\xa1");
 }
 
+// Test strings long enough for the word-at-a-time scan, with special
+// characters at every offset within a word
+void long_string_test()
+{
+    UniValue val;
+    for (unsigned int i = 0; i < 24; i++) {
+        string prefix(i, 'a');
+        string suffix(17, 'b');
+
+        f_assert(val.read("[\"" + prefix + "\\n" + suffix + "\"]"));
+        f_assert(val[0].get_str() == prefix + "\n" + suffix);
+
+        f_assert(val.read("[\"" + prefix + "\xc6\x91" + suffix + "\"]"));
+        f_assert(val[0].get_str() == prefix + "\xc6\x91" + suffix);
+
+        // unfinished UTF-8 followed by plain chars
+        f_assert(!val.read("[\"" + prefix + "\xc6" + suffix + "\"]"));
+        // raw control character
+        f_assert(!val.read("[\"" + prefix + "\t" + suffix + "\"]"));
+        // unterminated
+        f_assert(!val.read("[\"" + prefix + suffix));
+    }
+}
+
 int main (int argc, char *argv[])
 {
     for (unsigned int fidx = 0; fidx < ARRAY_SIZE(filenames); fidx++) {
@@ -164,6 +188,7 @@ int main (int argc, char *argv[])
     }
 
     unescape_unicode_test();
+    long_string_test();
 
     return test_failed ? 1 : 0;
 }
@@ -10,6 +10,7 @@
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkqueue.h>
+#include <clientversion.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
@@ -431,14 +432,14 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
 // Returns the script flags which should be checked for a given block
 static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& chainparams);
 
-static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
+static void LimitMempoolSize(CTxMemPool& pool, size_t limit, size_t datalimit, unsigned long age) {
     int expired = pool.Expire(GetTime() - age);
     if (expired != 0) {
         LogPrint(BCLog::MEMPOOL, "Expired %i transactions from the memory pool\n", expired);
     }
 
     std::vector<COutPoint> vNoSpendsRemaining;
-    pool.TrimToSize(limit, &vNoSpendsRemaining);
+    pool.TrimToSize(limit, &vNoSpendsRemaining, datalimit);
     for (const COutPoint& removed : vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
@@ -513,7 +514,7 @@ void UpdateMempoolForReorg(DisconnectedBlockTransactions &disconnectpool, bool f
     // We also need to remove any now-immature transactions
     mempool.removeForReorg(pcoinsTip.get(), chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
     // Re-limit mempool size, in case we added any transactions
-    LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-maxmempooldata", DEFAULT_MAX_MEMPOOL_DATA_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
 }
 
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
@@ -585,7 +586,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
     // Do not work on transactions that are too small.
     // A transaction with 1 segwit input and 1 P2WPHK output has non-witness size of 82 bytes.
     // Transactions smaller than this are not relayed to reduce unnecessary malloc overhead.
-    if (::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) < MIN_STANDARD_TX_NONWITNESS_SIZE)
+    if (tx.GetBaseSize() < MIN_STANDARD_TX_NONWITNESS_SIZE)
         return state.DoS(0, false, REJECT_NONSTANDARD, "tx-size-small");
 
     // Only accept nLockTime-using transactions that can be mined in the next
@@ -729,6 +730,8 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                 strprintf("%d", nSigOpsCost));
 
         CAmount mempoolRejectFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+        if (!tx.data.empty()) //DATACOIN payloads also pay the data budget min fee
+            mempoolRejectFee = std::max(mempoolRejectFee, pool.GetDataMinFee(gArgs.GetArg("-maxmempooldata", DEFAULT_MAX_MEMPOOL_DATA_SIZE) * 1000000).GetFee(nSize));
         if (!bypass_limits && mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nFees, mempoolRejectFee));
         }
@@ -977,7 +980,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
         // trim mempool and check if tx was trimmed
         if (!bypass_limits) {
-            LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+            LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-maxmempooldata", DEFAULT_MAX_MEMPOOL_DATA_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
             if (!pool.exists(hash))
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
         }
@@ -1337,6 +1340,7 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 
 static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
 static uint256 scriptExecutionCacheNonce(GetRandHash());
+static int64_t nScriptExecutionCacheNonceTime = GetTime();
 
 void InitScriptExecutionCache() {
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
@@ -1347,6 +1351,45 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+bool DumpScriptExecutionCache()
+{
+    CacheSnapshot snapshot;
+    snapshot.nClientVersion = CLIENT_VERSION;
+    snapshot.nScriptFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    {
+        LOCK(cs_main);
+        snapshot.nonce = scriptExecutionCacheNonce;
+        snapshot.nNonceTime = nScriptExecutionCacheNonceTime;
+        scriptExecutionCache.get_live(snapshot.entries);
+    }
+    if (!WriteCacheSnapshot(GetDataDir() / "scriptcache.dat", snapshot))
+        return false;
+    LogPrintf("Dumped %u script execution cache entries\n", snapshot.entries.size());
+    return true;
+}
+
+bool LoadScriptExecutionCache()
+{
+    fs::path path = GetDataDir() / "scriptcache.dat";
+    CacheSnapshot snapshot;
+    bool fLoaded = ReadCacheSnapshot(path, snapshot, STANDARD_SCRIPT_VERIFY_FLAGS);
+    // Never reuse a saved cache twice: it is rewritten on a clean shutdown
+    try {
+        fs::remove(path);
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("%s: Unable to remove saved script execution cache: %s\n", __func__, e.what());
+    }
+    if (!fLoaded)
+        return false;
+    LOCK(cs_main);
+    scriptExecutionCacheNonce = snapshot.nonce;
+    nScriptExecutionCacheNonceTime = snapshot.nNonceTime;
+    for (const uint256& entry : snapshot.entries)
+        scriptExecutionCache.insert(entry);
+    LogPrintf("Loaded %u script execution cache entries from disk\n", snapshot.entries.size());
+    return true;
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1688,6 +1731,31 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/** A script check run only to store its signatures in the signature cache.
+ *  The result is ignored, so a failing input does not stop the other
+ *  checks of the batch. */
+class CScriptCacheFillCheck
+{
+private:
+    CScriptCheck check;
+
+public:
+    CScriptCacheFillCheck() {}
+    CScriptCacheFillCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, PrecomputedTransactionData* txdataIn) :
+        check(outIn, txToIn, nInIn, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, txdataIn) { }
+
+    bool operator()() { check(); return true; }
+
+    void swap(CScriptCacheFillCheck& other) { check.swap(other.check); }
+};
+
+static CCheckQueue<CScriptCacheFillCheck> mempoolcheckqueue(128);
+
+void ThreadMempoolScriptCheck() {
+    RenameThread("datacoin-mempoolch");
+    mempoolcheckqueue.Thread();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -3627,7 +3695,8 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
         //Как же тогда отказывать фейковым новым блокам из сети?
         // ("How, then, to refuse fake new blocks from the network?")
         //Check POW and !!!SET pblock->nPrimeChainType, pblock->nPrimeChainLength HERE!!!
-        if (!CheckProofOfWork(pblock->GetHeaderHash(), pblock->nBits, chainparams.GetConsensus(), pblock->bnPrimeChainMultiplier, pblock->nPrimeChainType, pblock->nPrimeChainLength))
+        //(skipped if a message decode thread already did it)
+        if (!pblock->fCheckedPoW && !CheckProofOfWork(pblock->GetHeaderHash(), pblock->nBits, chainparams.GetConsensus(), pblock->bnPrimeChainMultiplier, pblock->nPrimeChainType, pblock->nPrimeChainLength))
             return state.DoS(100, error("ProcessNewBlock() : proof of work failed"));
 
 
@@ -4770,7 +4839,155 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION_NOSTATE = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+//! Transactions read from mempool.dat and validated together
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 256;
+
+/** A mempool.dat record. Version 2 files also carry the validated entry state,
+ *  which lets LoadMempool skip the policy checks when the chain tip is unchanged. */
+struct MempoolDumpEntry
+{
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+    CAmount nFee;
+    unsigned int nHeight;
+    bool spendsCoinbase;
+    int64_t nSigOpCost;
+};
+
+/**
+ * Put a dumped entry back in the mempool without the policy checks of AcceptToMemoryPool,
+ * which it passed at the tip it was dumped at. Nothing read from the file is trusted:
+ * the inputs, fee, sigops and lock points are worked out again and the scripts checked
+ * (against the signature cache PrecheckMempoolScripts filled), and a dumped state that
+ * disagrees means the entry goes through AcceptToMemoryPool instead.
+ */
+static bool RestoreMempoolEntry(const MempoolDumpEntry& e)
+{
+    AssertLockHeld(cs_main);
+    const CTransaction& tx = *e.tx;
+    CAmount nFee = 0;
+    int64_t nSigOpCost = 0;
+    bool fSpendsCoinbase = false;
+    LockPoints lp;
+    {
+        LOCK(mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+        CCoinsViewCache view(&viewMemPool);
+        // Parents must have been restored before us, and nothing loaded in the
+        // meantime (e.g. by a wallet) may spend the same outputs.
+        for (const CTxIn& txin : tx.vin) {
+            if (mempool.mapNextTx.count(txin.prevout))
+                return false;
+            const Coin& coin = view.AccessCoin(txin.prevout);
+            if (coin.IsSpent())
+                return false;
+            fSpendsCoinbase |= coin.IsCoinBase();
+        }
+
+        CValidationState state;
+        if (!Consensus::CheckTxInputs(tx, state, view, GetSpendHeight(view), nFee))
+            return false;
+        nSigOpCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+        if (nFee != e.nFee || nSigOpCost != e.nSigOpCost || fSpendsCoinbase != e.spendsCoinbase)
+            return false;
+        if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS) || !CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+            return false;
+        PrecomputedTransactionData txdata(tx);
+        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, txdata))
+            return false;
+
+        mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(e.tx, nFee, e.nTime, e.nHeight, fSpendsCoinbase, nSigOpCost, lp), false /* validFeeEstimate */);
+    }
+    GetMainSignals().TransactionAddedToMempool(e.tx);
+    return true;
+}
+
+/** Verify the scripts of a batch of transactions on the mempool check threads,
+ *  storing the signatures in the signature cache so that the serial
+ *  AcceptToMemoryPool calls which follow do not verify them again. A failing
+ *  transaction only misses the cache (and is rejected by AcceptToMemoryPool);
+ *  the checks of the others go on. */
+static void PrecheckMempoolScripts(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx)
+{
+    if (!nScriptCheckThreads)
+        return;
+
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(vtx.size());
+    std::vector<CScriptCacheFillCheck> vChecks;
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        CCoinsViewCache view(&viewMemPool);
+        for (const CTransactionRef& ptx : vtx) {
+            const CTransaction& tx = *ptx;
+            if (tx.IsCoinBase())
+                continue;
+            // Already in the chain, the pool or earlier in this batch
+            bool fHaveOutputs = false;
+            for (size_t o = 0; !fHaveOutputs && o < tx.vout.size(); o++)
+                fHaveOutputs = view.HaveCoin(COutPoint(tx.GetHash(), o));
+            if (fHaveOutputs)
+                continue;
+            bool fHaveInputs = true;
+            for (const CTxIn& txin : tx.vin) {
+                if (view.AccessCoin(txin.prevout).IsSpent()) {
+                    fHaveInputs = false;
+                    break;
+                }
+            }
+            if (!fHaveInputs)
+                continue;
+            txdata.emplace_back(tx);
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                vChecks.emplace_back(view.AccessCoin(tx.vin[i].prevout).out, tx, i, &txdata.back());
+            }
+            // Let later transactions in the batch spend this one
+            AddCoins(view, tx, MEMPOOL_HEIGHT);
+        }
+    }
+
+    CCheckQueueControl<CScriptCacheFillCheck> control(&mempoolcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vstate,
+                                     std::vector<bool>& vMissingInputs, const CAmount nAbsurdFee)
+{
+    const CChainParams& chainparams = Params();
+    vstate.assign(vtx.size(), CValidationState());
+    vMissingInputs.assign(vtx.size(), false);
+
+    PrecheckMempoolScripts(pool, vtx);
+
+    unsigned int nAccepted = 0;
+    LOCK(cs_main);
+    int64_t nAcceptTime = GetTime();
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (pool.exists(vtx[i]->GetHash())) {
+            ++nAccepted;
+            continue;
+        }
+        std::vector<COutPoint> coins_to_uncache;
+        bool fMissingInputs = false;
+        if (AcceptToMemoryPoolWorker(chainparams, pool, vstate[i], vtx[i], &fMissingInputs, nAcceptTime,
+                                     nullptr /* plTxnReplaced */, false /* bypass_limits */, nAbsurdFee, coins_to_uncache)) {
+            ++nAccepted;
+        } else {
+            for (const COutPoint& hashTx : coins_to_uncache)
+                pcoinsTip->Uncache(hashTx);
+        }
+        vMissingInputs[i] = fMissingInputs;
+    }
+    // One coins cache size check for the whole batch
+    CValidationState stateDummy;
+    FlushStateToDisk(chainparams, stateDummy, FLUSH_STATE_PERIODIC);
+    return nAccepted;
+}
 
 bool LoadMempool(void)
 {
@@ -4784,6 +5001,7 @@ bool LoadMempool(void)
     }
 
     int64_t count = 0;
+    int64_t restored = 0;
     int64_t expired = 0;
     int64_t failed = 0;
     int64_t already_there = 0;
@@ -4792,43 +5010,84 @@ bool LoadMempool(void)
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NOSTATE) {
             return false;
         }
+        const bool fHaveState = version == MEMPOOL_DUMP_VERSION;
+        uint256 hashTip;
+        if (fHaveState) {
+            file >> hashTip;
+        }
         uint64_t num;
         file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+
+        std::vector<MempoolDumpEntry> vBatch;
+        while (num) {
+            vBatch.clear();
+            while (num && vBatch.size() < MEMPOOL_LOAD_BATCH_SIZE) {
+                --num;
+                MempoolDumpEntry e;
+                file >> e.tx;
+                file >> e.nTime;
+                file >> e.nFeeDelta;
+
+                CAmount amountdelta = e.nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(e.tx->GetHash(), amountdelta);
+                }
+                if (fHaveState) {
+                    file >> e.nFee;
+                    file >> e.nHeight;
+                    file >> e.spendsCoinbase;
+                    file >> e.nSigOpCost;
+                    // Lock points are worked out again on restore
+                    int lockHeight;
+                    int64_t lockTime;
+                    uint256 hashLockBlock;
+                    file >> lockHeight;
+                    file >> lockTime;
+                    file >> hashLockBlock;
+                }
+                if (e.nTime + nExpiryTimeout > nNow) {
+                    vBatch.push_back(std::move(e));
+                } else {
+                    ++expired;
+                }
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
+
+            bool fRestore = false;
+            if (fHaveState) {
+                LOCK(cs_main);
+                fRestore = chainActive.Tip() && chainActive.Tip()->GetBlockHash() == hashTip;
+            }
+            std::vector<CTransactionRef> vtx;
+            vtx.reserve(vBatch.size());
+            for (const MempoolDumpEntry& e : vBatch)
+                vtx.push_back(e.tx);
+            PrecheckMempoolScripts(mempool, vtx);
+
+            for (const MempoolDumpEntry& e : vBatch) {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
+                if (mempool.exists(e.tx->GetHash())) {
+                    // mempool may contain the transaction already, e.g. from
+                    // wallet(s) having loaded it while we were processing
+                    // mempool transactions
+                    ++already_there;
+                    continue;
+                }
+                if (fRestore && chainActive.Tip()->GetBlockHash() == hashTip && RestoreMempoolEntry(e)) {
+                    ++count;
+                    ++restored;
+                    continue;
+                }
+                CValidationState state;
+                AcceptToMemoryPoolWithTime(chainparams, mempool, state, e.tx, nullptr /* pfMissingInputs */, e.nTime,
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
                 if (state.IsValid()) {
                     ++count;
                 } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (mempool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
+                    ++failed;
                 }
-            } else {
-                ++expired;
             }
             if (ShutdownRequested())
                 return false;
@@ -4844,7 +5103,13 @@ bool LoadMempool(void)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
+    if (restored) {
+        // Restored entries skipped the size limit checks of AcceptToMemoryPool
+        LOCK(cs_main);
+        LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-maxmempooldata", DEFAULT_MAX_MEMPOOL_DATA_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i succeeded (%i restored without policy checks), %i failed, %i expired, %i already there\n", count, restored, failed, expired, already_there);
     return true;
 }
 
@@ -4853,14 +5118,17 @@ bool DumpMempool(void)
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    std::vector<CTxMemPoolEntry> ventries;
+    uint256 hashTip;
 
     {
-        LOCK(mempool.cs);
+        LOCK2(cs_main, mempool.cs);
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
-        vinfo = mempool.infoAll();
+        ventries = mempool.entryAll();
+        if (chainActive.Tip())
+            hashTip = chainActive.Tip()->GetBlockHash();
     }
 
     int64_t mid = GetTimeMicros();
@@ -4875,13 +5143,22 @@ bool DumpMempool(void)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
-
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetHash());
+        file << hashTip;
+
+        file << (uint64_t)ventries.size();
+        for (const CTxMemPoolEntry& e : ventries) {
+            const LockPoints& lp = e.GetLockPoints();
+            file << e.GetTx();
+            file << (int64_t)e.GetTime();
+            file << (int64_t)(e.GetModifiedFee() - e.GetFee());
+            file << e.GetFee();
+            file << e.GetHeight();
+            file << e.GetSpendsCoinbase();
+            file << e.GetSigOpCost();
+            file << lp.height;
+            file << lp.time;
+            file << (lp.maxInputBlock ? lp.maxInputBlock->GetBlockHash() : uint256());
+            mapDeltas.erase(e.GetTx().GetHash());
         }
 
         file << mapDeltas;
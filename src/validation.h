@@ -82,8 +82,19 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Upper bound on the number of blocks that can be requested at any given time from a single peer.
+ *  The actual per-peer limit is sized from the peer's measured block throughput and latency. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 1000; //DATACOIN SYNC. Agrressive sync. was 16
+/** Number of blocks that can be in flight from a peer whose block throughput has not been measured yet. */
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Lower bound on the adaptive number of blocks in flight from a single peer. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** Amount of delivery time (in seconds, on top of the measured latency) we try to keep queued at each peer. */
+static const int64_t BLOCK_DOWNLOAD_TARGET_QUEUE_TIME = 10;
+/** Number of blocks past the last common block in which an overdue in-flight block may be re-requested from a faster peer. */
+static const int BLOCK_DOWNLOAD_REREQUEST_WINDOW = 16;
+/** Minimum time (in seconds) a block must have been in flight before it is re-requested from a faster peer. */
+static const int64_t BLOCK_DOWNLOAD_REREQUEST_MIN_TIME = 5;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -115,6 +126,13 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Transactions with a data payload of at least DATA_PAYLOAD_DEFER_SIZE are announced from
+ *  a separate per-peer byte budget (and their own INVENTORY_BROADCAST_MAX slots), so they
+ *  neither use up nor delay the slots above. This is the rate at which that budget refills,
+ *  in bytes per second. */
+static const unsigned int INVENTORY_LARGE_TX_BYTES_PER_SECOND = 64 * 1024;
+/** Maximum per-peer budget for announcing large transactions, in bytes. */
+static const unsigned int INVENTORY_LARGE_TX_BURST = 1024 * 1024;
 /** Average delay between feefilter broadcasts in seconds. */
 static const unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
@@ -162,8 +180,8 @@ extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap& mapBlockIndex;
-extern uint64_t nLastBlockTx;
-extern uint64_t nLastBlockWeight;
+extern std::atomic<uint64_t> nLastBlockTx;
+extern std::atomic<uint64_t> nLastBlockWeight;
 extern const std::string strMessageMagic;
 extern CWaitableCriticalSection csBestBlock;
 extern CConditionVariable cvBlockChange;
@@ -275,6 +293,8 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread filling the signature cache for mempool batches */
+void ThreadMempoolScriptCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -312,6 +332,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee);
 
+/** (try to) add a batch of transactions to memory pool, in order, so a batch
+ * may contain chains of unconfirmed transactions. Scripts are verified on the
+ * script check threads first and the batch is then accepted under a single
+ * cs_main acquisition, so callers should keep batches small. vstate and
+ * vMissingInputs receive per-transaction results. A transaction already in
+ * the pool, including one repeated within the batch, is reported as accepted,
+ * as sendrawtransaction does. Returns the number of transactions accepted. **/
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vstate,
+                                     std::vector<bool>& vMissingInputs, const CAmount nAbsurdFee);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -394,6 +424,10 @@ public:
 
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
+/** Save the script execution cache to scriptcache.dat */
+bool DumpScriptExecutionCache();
+/** Restore the script execution cache from scriptcache.dat, before any script is checked */
+bool LoadScriptExecutionCache();
 
 
 /** Functions for disk access for blocks */
@@ -483,7 +517,8 @@ CBlockFileInfo* GetBlockFileInfo(size_t n);
 /** Dump the mempool to disk. */
 bool DumpMempool();
 
-/** Load the mempool from disk. */
+/** Load the mempool from disk. Entries dumped at the current tip are restored
+ *  without re-validation; otherwise they go through AcceptToMemoryPool. */
 bool LoadMempool();
 
 #endif // BITCOIN_VALIDATION_H
@@ -549,25 +549,47 @@ UniValue senddata(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is not available\n");
     }
 	
-    if (request.fHelp || 1 != request.params.size())
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
         throw std::runtime_error(
-            "senddata data\n"
-            "1. data        (String) Base64 encoded data chunk"
+            "senddata data ( fee_rate \"change_address\" )\n"
+            "1. data            (String) Base64 encoded data chunk\n"
+            "2. fee_rate        (numeric, optional) Fee rate in " + CURRENCY_UNIT + "/kB to use instead of the wallet's\n"
+            "3. change_address  (string, optional) The address to send the change to\n"
+            "\nThe data can also be sent as the raw body of an HTTP POST to /senddata (or\n"
+            "/senddata/<walletname>), with the options in X-Fee-Rate and X-Change-Address headers."
             + HelpRequiringPassphrase(pwallet));
 
     CWalletTx wtx;
 
     // Transaction data
-    std::string txdata;
-    if (request.params.size() > 0 && request.params[0].type() != UniValue::VNULL && !request.params[0].get_str().empty()) {
-        txdata = request.params[0].get_str();
+    std::vector<unsigned char> vchData;
+    if (!request.binaryData.empty()) {
+        vchData = std::move(request.binaryData);
+        if (vchData.size() > MAX_TX_DATA_SIZE)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "data chunk is too long. split it the payload to several transactions.");
+    } else if (request.params[0].type() != UniValue::VNULL && !request.params[0].get_str().empty()) {
+        const std::string& txdata = request.params[0].get_str();
         if (txdata.length() > MAX_TX_DATA_SIZE)
             throw JSONRPCError(RPC_INVALID_PARAMETER, "data chunk is too long. split it the payload to several transactions.");
+        vchData = DecodeBase64(txdata.c_str());
+    }
+
+    CCoinControl coin_control;
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        coin_control.m_feerate = CFeeRate(AmountFromValue(request.params[1]));
+        coin_control.fOverrideFeeRate = true;
+    }
+    if (request.params.size() > 2 && !request.params[2].isNull()) {
+        CTxDestination dest = DecodeDestination(request.params[2].get_str());
+        if (!IsValidDestination(dest)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "change_address must be a valid datacoin address");
+        }
+        coin_control.destChange = dest;
     }
 
 	EnsureWalletIsUnlocked(pwallet);
 	
-    std::string strError = pwallet->SendData(wtx, false, txdata);
+    std::string strError = pwallet->SendData(wtx, false, std::move(vchData), coin_control);
 	
     if (strError != "")
         throw JSONRPCError(RPC_WALLET_ERROR, strError);
@@ -3686,7 +3708,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "sendmany",                 &sendmany,                 {"fromaccount","amounts","minconf","comment","subtractfeefrom","replaceable","conf_target","estimate_mode"} },
     { "wallet",             "sendtoaddress",            &sendtoaddress,            {"address","amount","comment","comment_to","subtractfeefromamount","replaceable","conf_target","estimate_mode"} },
 
-    { "wallet",             "senddata",                 &senddata,                 {"data"} },
+    { "wallet",             "senddata",                 &senddata,                 {"data","fee_rate","change_address"} },
     { "wallet",             "getdata",                  &getdata,                  {"hash"} },
  
     { "wallet",             "setaccount",               &setaccount,               {"address","account"} },
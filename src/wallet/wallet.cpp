@@ -2665,6 +2665,12 @@ OutputType CWallet::TransactionChangeType(OutputType change_type, const std::vec
 
 bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet,
                                 int& nChangePosInOut, std::string& strFailReason, const CCoinControl& coin_control, const std::string& txData, bool sign)
+{
+    return CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, nChangePosInOut, strFailReason, coin_control, DecodeBase64(txData.c_str()), sign);
+}
+
+bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet,
+                                int& nChangePosInOut, std::string& strFailReason, const CCoinControl& coin_control, std::vector<unsigned char> vchData, bool sign)
 {
     CAmount nValue = 0;
     int nChangePosRequest = nChangePosInOut;
@@ -2690,10 +2696,8 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
     wtxNew.fTimeReceivedIsTxTime = true;
     wtxNew.BindWallet(this);
 
-	auto txdecdata = DecodeBase64(txData.c_str());
-	
     // transaction data
-    if (txdecdata.size() > MAX_TX_DATA_SIZE) {
+    if (vchData.size() > MAX_TX_DATA_SIZE) {
         strFailReason = _("txData is too long");
         return false;
     }
@@ -2733,7 +2737,7 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
     assert(txNew.nLockTime < LOCKTIME_THRESHOLD);
     FeeCalculation feeCalc;
     CAmount nFeeNeeded;
-	txNew.data = txdecdata;
+	txNew.data = std::move(vchData);
     unsigned int nBytes;
     {
         std::set<CInputCoin> setCoins;
@@ -2796,7 +2800,7 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                 for (const auto& recipient : vecSend)
                 {
                     // don't create an output for zero coins in data transaction
-                    if (0 == recipient.nAmount && txdecdata.size() > 0)
+                    if (0 == recipient.nAmount && txNew.data.size() > 0)
                         continue;
 
                     CTxOut txout(recipient.nAmount, recipient.scriptPubKey);
@@ -3117,6 +3121,12 @@ bool CWallet::AddAccountingEntry(const CAccountingEntry& acentry, CWalletDB *pwa
 }
 
 std::string CWallet::SendData(CWalletTx& wtxNew, bool fAskFee, const std::string& txData)
+{
+    CCoinControl no_coin_control;
+    return SendData(wtxNew, fAskFee, DecodeBase64(txData.c_str()), no_coin_control);
+}
+
+std::string CWallet::SendData(CWalletTx& wtxNew, bool fAskFee, std::vector<unsigned char> vchData, const CCoinControl& coin_control)
 {
     // Check amount
     if (payTxFee.GetFeePerK() > GetBalance())
@@ -3136,8 +3146,7 @@ std::string CWallet::SendData(CWalletTx& wtxNew, bool fAskFee, const std::string
 	std::vector<CRecipient> vecSend;
     //CScript scriptPubKey;
 	int nChangePosRet = -1;
-	CCoinControl no_coin_control; // This is a deprecated API
-    if (!CreateTransaction(vecSend, wtxNew, reservekey, nFeeRequired, nChangePosRet, strError,  no_coin_control, txData))
+    if (!CreateTransaction(vecSend, wtxNew, reservekey, nFeeRequired, nChangePosRet, strError, coin_control, std::move(vchData)))
     {
         if (nFeeRequired > GetBalance())
             strError = strprintf(_("Error: This transaction requires a transaction fee of at least %s because of its amount, complexity, or use of recently received funds!"), FormatMoney(nFeeRequired).c_str());
@@ -982,8 +982,13 @@ public:
      */
     bool CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosInOut,
                            std::string& strFailReason, const CCoinControl& coin_control, const std::string &txData, bool sign = true);
+    /** As above, with the data payload as raw bytes instead of base64. Pass
+     *  the payload as an rvalue to move it into the transaction uncopied. */
+    bool CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosInOut,
+                           std::string& strFailReason, const CCoinControl& coin_control, std::vector<unsigned char> vchData, bool sign = true);
     bool CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, CConnman* connman, CValidationState& state);
     std::string SendData(CWalletTx& wtxNew, bool fAskFee, const std::string& txData);
+    std::string SendData(CWalletTx& wtxNew, bool fAskFee, std::vector<unsigned char> vchData, const CCoinControl& coin_control);
 
 
     void ListAccountCreditDebit(const std::string& strAccount, std::list<CAccountingEntry>& entries);
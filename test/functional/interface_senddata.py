@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Datacoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the binary /senddata HTTP endpoint.
+
+Post the raw payload of a data transaction as the request body and check
+that it ends up in the mempool unchanged. Empty and oversized bodies, and
+methods other than POST, must be rejected.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+import base64
+import http.client
+import json
+import urllib.parse
+
+COINBASE_MATURITY = 3000
+MAX_TX_DATA_SIZE = 128 * 1024
+
+class SendDataTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+
+    def senddata_call(self, body, method='POST', headers={}):
+        url = urllib.parse.urlparse(self.nodes[0].url)
+        authpair = url.username + ':' + url.password
+        request_headers = {"Authorization": "Basic " + str_to_b64str(authpair)}
+        request_headers.update(headers)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request(method, '/senddata', body, request_headers)
+        response = conn.getresponse()
+        return response.status, response.read()
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.log.info("Mining blocks...")
+        node.generate(COINBASE_MATURITY + 1)
+        assert(node.getbalance() > 0)
+
+        self.log.info("Post a payload")
+        payload = bytes(range(256)) * 16
+        status, out = self.senddata_call(payload)
+        assert_equal(status, http.client.OK)
+        reply = json.loads(out.decode('utf-8'))
+        assert_equal(reply['error'], None)
+        txid = reply['result']
+        assert(txid in node.getrawmempool())
+        assert_equal(base64.b64decode(node.getdata(txid)), payload)
+
+        self.log.info("Post a payload with a fee rate")
+        status, out = self.senddata_call(payload[:1000], headers={"X-Fee-Rate": "0.01"})
+        assert_equal(status, http.client.OK)
+        txid = json.loads(out.decode('utf-8'))['result']
+        assert(txid in node.getrawmempool())
+
+        self.log.info("Reject an empty body")
+        status, out = self.senddata_call(b'')
+        assert_equal(status, http.client.INTERNAL_SERVER_ERROR)
+        error = json.loads(out.decode('utf-8'))['error']
+        assert_equal(error['code'], -8)
+        assert_equal(error['message'], "Empty request body")
+
+        self.log.info("Reject an oversized body")
+        mempool_size = len(node.getrawmempool())
+        status, out = self.senddata_call(b'\x01' * (MAX_TX_DATA_SIZE + 1))
+        assert_equal(status, http.client.INTERNAL_SERVER_ERROR)
+        error = json.loads(out.decode('utf-8'))['error']
+        assert_equal(error['code'], -8)
+        assert('data chunk is too long' in error['message'])
+        assert_equal(len(node.getrawmempool()), mempool_size)
+
+        self.log.info("Only POST is accepted")
+        status, out = self.senddata_call(payload, method='GET')
+        assert_equal(status, http.client.METHOD_NOT_ALLOWED)
+
+if __name__ == '__main__':
+    SendDataTest().main()
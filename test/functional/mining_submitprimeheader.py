@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Datacoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the submitprimeheader RPC.
+
+Node 1 hands out templates. Its arguments are checked first: template ids
+that are malformed, unknown or pushed out of the recent template window, a
+coinbase argument that is not a coinbase, out of range ntime and nonce, and
+malformed multipliers.
+
+For a successful submit, node 0 is split off and mines the next block on the
+same tip. Node 1 takes a template for that tip, serves more getblocktemplate
+calls (which update the time and reset the nonce of the shared template),
+and then completes the template with node 0's coinbase and header fields.
+That must give node 0's block, which becomes node 1's tip.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+import time
+
+MAX_RECENT_TEMPLATES = 16
+
+class SubmitPrimeHeaderTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+
+    def header_fields(self, node, blockhash):
+        block = node.getblock(blockhash, 2)
+        return [block['tx'][0]['hex'], block['time'], block['nonce'],
+                '%x' % int(block['primechainmultiplier']), block['version']]
+
+    def run_test(self):
+        node = self.nodes[1]
+
+        # Mine a block to leave initial block download
+        node.generate(1)
+        self.sync_all()
+        templateid = node.getblocktemplate()['templateid']
+        coinbase, ntime, nonce, multiplier, _ = self.header_fields(node, node.getbestblockhash())
+
+        self.log.info("Test unknown template ids")
+        assert_raises_rpc_error(-8, "Invalid template id", node.submitprimeheader, "abc", coinbase, ntime, nonce, multiplier)
+        assert_raises_rpc_error(-8, "Unknown or expired template id", node.submitprimeheader, str(int(templateid) + 1), coinbase, ntime, nonce, multiplier)
+
+        self.log.info("Test a coinbase argument that is not a coinbase")
+        assert_raises_rpc_error(-22, "Coinbase decode failed", node.submitprimeheader, templateid, "zz", ntime, nonce, multiplier)
+        rawtx = node.createrawtransaction([{"txid": "ff" * 32, "vout": 0}], {node.getnewaddress(): 1})
+        assert_raises_rpc_error(-22, "Transaction is not a coinbase", node.submitprimeheader, templateid, rawtx, ntime, nonce, multiplier)
+
+        self.log.info("Test out of range ntime and nonce")
+        for bad_ntime, bad_nonce in [(-1, nonce), (2 ** 32, nonce), (ntime, -1), (ntime, 2 ** 32)]:
+            assert_raises_rpc_error(-8, "ntime and nonce must be 32-bit unsigned values", node.submitprimeheader, templateid, coinbase, bad_ntime, bad_nonce, multiplier)
+
+        self.log.info("Test malformed multipliers")
+        for bad_multiplier in ["", "0x", "xyz", "12g4"]:
+            assert_raises_rpc_error(-8, "multiplier must be a hex number", node.submitprimeheader, templateid, coinbase, ntime, nonce, bad_multiplier)
+
+        self.log.info("Test a header without the proof of work")
+        assert_equal(node.submitprimeheader(templateid, coinbase, ntime, nonce, "1"), "high-hash")
+        assert_equal(node.getbestblockhash(), self.nodes[0].getbestblockhash())
+
+        self.log.info("Test a template id older than the recent template window")
+        for i in range(MAX_RECENT_TEMPLATES):
+            node.generate(1)
+            assert_equal(node.getblocktemplate()['templateid'], str(int(templateid) + i + 1))
+        assert_equal(node.submitprimeheader(str(int(templateid) + 1), coinbase, ntime, nonce, "1"), "high-hash")
+        assert_raises_rpc_error(-8, "Unknown or expired template id", node.submitprimeheader, templateid, coinbase, ntime, nonce, multiplier)
+        self.sync_all()
+
+        self.log.info("Test a successful submit")
+        disconnect_nodes(self.nodes[0], 1)
+        tip = node.getbestblockhash()
+        templateid = node.getblocktemplate()['templateid']
+        blockhash = self.nodes[0].generate(1)[0]
+        assert_equal(node.getbestblockhash(), tip)
+
+        # Later calls update the time and reset the nonce of the same template,
+        # or (with other rules) build another one
+        time.sleep(1)
+        assert_equal(node.getblocktemplate()['templateid'], templateid)
+        assert_equal(node.getblocktemplate({'rules': ['segwit']})['templateid'], str(int(templateid) + 1))
+
+        assert_equal(node.submitprimeheader(templateid, *self.header_fields(self.nodes[0], blockhash)), None)
+        assert_equal(node.getbestblockhash(), blockhash)
+        assert_equal(node.submitprimeheader(templateid, *self.header_fields(self.nodes[0], blockhash)), "duplicate")
+
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.sync_all()
+
+if __name__ == '__main__':
+    SubmitPrimeHeaderTest().main()
@@ -75,6 +75,7 @@ BASE_SCRIPTS= [
     'mempool_limit.py',
     'rpc_txoutproof.py',
     'wallet_listreceivedby.py',
+    'interface_senddata.py',
     'wallet_abandonconflict.py',
     'feature_csv_activation.py',
     'rpc_rawtransaction.py',
@@ -117,6 +118,7 @@ BASE_SCRIPTS= [
     'feature_nulldummy.py',
     'wallet_import_rescan.py',
     'mining_basic.py',
+    'mining_submitprimeheader.py',
     'wallet_bumpfee.py',
     'rpc_named_arguments.py',
     'wallet_listsinceblock.py',